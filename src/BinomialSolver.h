@@ -10,11 +10,21 @@ class BinomialSolver : public CoordSolver<T> {
     typedef Eigen::VectorXi VecXi;
     typedef Eigen::Map<const Eigen::MatrixXd> MapMat;
     typedef Eigen::MappedSparseMatrix<double> MapSpMat;
+    typedef Eigen::Matrix<typename T::Scalar, Eigen::Dynamic, Eigen::Dynamic> MatX;
     typedef Eigen::Map<const Eigen::VectorXd> MapVec;
 
 private:
     VecXd xbeta;
     VecXd prob;
+    VecXd betas_xbeta;
+    double b0_xbeta;
+    int xbeta_updates;
+    const int xbeta_refresh = 20;
+    const bool bounded_hessian;
+    bool bound_steps;
+    VecXd xv_bound;
+    VecXd penalty_exact;
+    using CoordSolver<T>::select_kernel;
     using CoordSolver<T>::n;
     using CoordSolver<T>::nv_total;
     using CoordSolver<T>::intercept;
@@ -29,6 +39,9 @@ private:
     using CoordSolver<T>::xs;
     using CoordSolver<T>::xv;
     using CoordSolver<T>::residuals;
+    using CoordSolver<T>::resids_sum;
+    using CoordSolver<T>::xw;
+    using CoordSolver<T>::active_set;
     using CoordSolver<T>::gradient;
     using CoordSolver<T>::betas;
     using CoordSolver<T>::b0;
@@ -39,6 +52,17 @@ private:
     using CoordSolver<T>::penalty_type;
     using CoordSolver<T>::cmult;
     using CoordSolver<T>::strong_set;
+    using CoordSolver<T>::strong_idx;
+    using CoordSolver<T>::strong_left;
+    using CoordSolver<T>::track_changes;
+    using CoordSolver<T>::changed_idx;
+    using CoordSolver<T>::clear_changed;
+    using CoordSolver<T>::xv_stale;
+    using CoordSolver<T>::merge_strong;
+    using CoordSolver<T>::cache_slot;
+    using CoordSolver<T>::cached_col;
+    using CoordSolver<T>::compute_gradient;
+    using CoordSolver<T>::standardized_axpy;
     const double prob_thresh = 1e-9;
     double xbeta_thresh;
 
@@ -46,9 +70,9 @@ private:
 public:
     // constructor (dense X matrix)
     BinomialSolver(const Eigen::Ref<const Eigen::MatrixXd> & y_,
-                   const Eigen::Ref<const Eigen::MatrixXd> & X_,
+                   const Eigen::Ref<const MatX> & X_,
                    const Eigen::Ref<const Eigen::MatrixXd> & Fixed_,
-                   const Eigen::Ref<const Eigen::MatrixXd> & XZ_,
+                   const XZMatrix<T> & XZ_,
                    const double * xmptr,
                    double * xvptr,
                    const double * xsptr,
@@ -62,7 +86,8 @@ public:
                    int ne_,
                    int nx_,
                    double tolerance_,
-                   int max_iterations_) :
+                   int max_iterations_,
+                   bool bounded_hessian_) :
     CoordSolver<T>(y_,
                    X_,
                    Fixed_,
@@ -82,9 +107,16 @@ public:
                    tolerance_,
                    max_iterations_),
                    xbeta(n),
-                   prob(n)
+                   prob(n),
+                   betas_xbeta(nv_total),
+                   b0_xbeta(0.0),
+                   xbeta_updates(0),
+                   bounded_hessian(bounded_hessian_),
+                   bound_steps(bounded_hessian_),
+                   penalty_exact(VecXd::Constant(2, -1.0))
                    {
                        xbeta_thresh = log((1 - prob_thresh) / prob_thresh);
+                       track_changes = true;
                        init();
                    };
 
@@ -92,7 +124,7 @@ public:
     BinomialSolver(const Eigen::Ref<const Eigen::MatrixXd> & y_,
                    const MapSpMat X_,
                    const Eigen::Ref<const Eigen::MatrixXd> & Fixed_,
-                   const Eigen::Ref<const Eigen::MatrixXd> & XZ_,
+                   const XZMatrix<T> & XZ_,
                    const double * xmptr,
                    double * xvptr,
                    const double * xsptr,
@@ -106,7 +138,8 @@ public:
                    int ne_,
                    int nx_,
                    double tolerance_,
-                   int max_iterations_) :
+                   int max_iterations_,
+                   bool bounded_hessian_) :
         CoordSolver<T>(y_,
                        X_,
                        Fixed_,
@@ -126,19 +159,34 @@ public:
                        tolerance_,
                        max_iterations_),
                        xbeta(n),
-                       prob(n)
+                       prob(n),
+                       betas_xbeta(nv_total),
+                       b0_xbeta(0.0),
+                       xbeta_updates(0),
+                       bounded_hessian(bounded_hessian_),
+                       bound_steps(bounded_hessian_),
+                       penalty_exact(VecXd::Constant(2, -1.0))
                        {
                            xbeta_thresh = log((1 - prob_thresh) / prob_thresh);
+                           track_changes = true;
                            init();
                        };
 
     // destructor
     virtual ~BinomialSolver() {}
 
+    // copy of the solver with weighted sum squares in xvptr
+    virtual CoordSolver<T> * clone(double * xvptr) const {
+        BinomialSolver<T> * s = new BinomialSolver<T>(*this);
+        s->rebind_xv(xvptr);
+        return s;
+    }
+
     // initialize function
     void init() {
 
         xbeta = Eigen::VectorXd::Zero(n);
+        betas_xbeta = Eigen::VectorXd::Zero(nv_total);
         prob = Eigen::VectorXd::Constant(n, 0.5);
 
         // initial p(y = 1) for all obs.
@@ -149,9 +197,10 @@ public:
             prob0 = 0.5;
         }
 
-        // initial value of intercept and sum of wgts
+        // initial value of intercept and sum of wgts, the weights stay at the
+        // upper bound 0.25 of the logistic hessian if bounded_hessian
         b0 = log(prob0 / (1.0 - prob0));
-        wgts_sum = prob0 * (1 - prob0);
+        wgts_sum = bounded_hessian ? 0.25 : prob0 * (1 - prob0);
 
         // initial wgts
         wgts.array() = wgts_user.array() * wgts_sum;
@@ -159,20 +208,27 @@ public:
         // initial residuals
         residuals.array() = wgts_user.array() * (y.col(0).array() - prob0);
 
-        // initial weighted sum squares x / xz cols and gradient
+        // initial gradient
+        compute_gradient();
+
+        // initial weighted sum squares x / xz cols
         int idx = 0;
         for (int k = 0; k < X.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (X.col(k).dot(residuals) - xm[idx] * residuals.sum());
-            xv[idx] = std::pow(xs[idx], 2) * (X.col(k).cwiseProduct(X.col(k)) - 2 * xm[idx] * X.col(k) + std::pow(xm[idx], 2) * Eigen::VectorXd::Ones(n)).adjoint() * wgts;
+            xv[idx] = std::pow(xs[idx], 2) * weighted_sum_squares(X.col(k), xm[idx], wgts, wgts_sum);
         }
         for (int k = 0; k < Fixed.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (Fixed.col(k).dot(residuals) - xm[idx] * residuals.sum());
-            xv[idx] = std::pow(xs[idx], 2) * (Fixed.col(k).cwiseProduct(Fixed.col(k)) - 2 * xm[idx] * Fixed.col(k) + std::pow(xm[idx], 2) * Eigen::VectorXd::Ones(n)).adjoint() * wgts;
+            xv[idx] = std::pow(xs[idx], 2) * weighted_sum_squares(Fixed.col(k), xm[idx], wgts, wgts_sum);
         }
         for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (XZ.col(k).dot(residuals) - xm[idx] * residuals.sum());
-            xv[idx] = std::pow(xs[idx], 2) * (XZ.col(k).cwiseProduct(XZ.col(k)) - 2 * xm[idx] * XZ.col(k) + std::pow(xm[idx], 2) * Eigen::VectorXd::Ones(n)).adjoint() * wgts;
+            const auto xzk = XZ.col(k);
+            xv[idx] = std::pow(xs[idx], 2) * weighted_sum_squares(xzk, xm[idx], wgts, wgts_sum);
         }
+
+        // weighted sum squares under the bound, restored at each new penalty
+        if (bounded_hessian) xv_bound = xv;
+
+        // weights only stay fixed under bounded hessian
+        select_kernel(bounded_hessian);
     }
 
     // warm start initialization given current estimates
@@ -183,67 +239,151 @@ public:
         b0 = b0_start;
         betas = betas_start;
 
-        // update residuals, working response, weighted sum squres X / XZ
+        // update residuals (linear predictor recomputed from scratch),
+        // working response, weighted sum squres X / XZ
+        xbeta_updates = 0;
         update_quadratic();
 
         // update gradients given current residuals
-        int idx = 0;
-        for (int k = 0; k < X.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (X.col(k).dot(residuals) - xm[idx] * residuals.sum());
-        }
-        idx += Fixed.cols();
-        for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (XZ.col(k).dot(residuals) - xm[idx] * residuals.sum());
-        }
+        compute_gradient();
     }
 
     // update quadratic approx. of log-likelihood
     virtual void update_quadratic() {
-        // compute linear predictor (X * beta)
-        xbeta.array() = b0;
-        int idx = 0;
-        for (int j = 0; j < X.cols(); ++j, ++idx) {
-            if (strong_set[idx] && betas[idx] != 0.0) {
-                xbeta += xs[idx] * (X.col(j) - xm[idx] * Eigen::VectorXd::Ones(n)) * betas[idx];
-            }
-        }
-        for (int j = 0; j < Fixed.cols(); ++j, ++idx) {
-            xbeta += xs[idx] * (Fixed.col(j) - xm[idx] * Eigen::VectorXd::Ones(n)) * betas[idx];
-        }
-        for (int j = 0; j < XZ.cols(); ++j, ++idx) {
-            if (strong_set[idx] && betas[idx] != 0.0) {
-                xbeta += xs[idx] * (XZ.col(j) - xm[idx] * Eigen::VectorXd::Ones(n)) * betas[idx];
-            }
+        // compute linear predictor (X * beta), it is updated from the changes
+        // in estimates since the last iteration and recomputed from scratch
+        // every xbeta_refresh iterations to limit accumulated rounding error
+        if (xbeta_updates == 0) {
+            xbeta.array() = b0;
+            betas_xbeta.setZero();
+            add_linear_predictor(X, 0);
+            add_linear_predictor(Fixed, X.cols());
+            add_linear_predictor(XZ, X.cols() + Fixed.cols());
+        } else {
+            update_linear_predictor();
         }
+        clear_changed();
+        strong_left.clear();
+        b0_xbeta = b0;
+        xbeta_updates = (xbeta_updates + 1) % xbeta_refresh;
 
         // compute predicted probabilities
-        for (int i = 0; i < n; ++i) {
-            prob[i] = abs(xbeta[i]) < xbeta_thresh ? 1.0 / (1.0 + exp(-xbeta[i])) : xbeta[i] > 0 ? 1.0 : 0.0;
+        logistic(xbeta, xbeta_thresh, prob);
+
+        // update residuals
+        residuals.array() = wgts_user.array() * (y.col(0).array() - prob.array());
+        resids_sum = residuals.sum();
+
+        // weights (and weighted norms) are fixed under bounded hessian until
+        // the bounded steps converge, they return to the bound at a new penalty
+        if (bounded_hessian) {
+            if (!bound_steps && penalty != penalty_exact) bound_weights();
+            if (bound_steps) return;
         }
 
         // update weights
         wgts.array() = wgts_user.array() * prob.array() * (1 - prob.array());
         wgts_sum = wgts.sum();
 
-        // update residuals
-        residuals.array() = wgts_user.array() * (y.col(0).array() - prob.array());
+        // update weighted sum squares x / xz cols (and weighted sums of
+        // active cols used to maintain the residual sum)
+        update_weighted_norms(X, 0);
+        update_weighted_norms(Fixed, X.cols());
+        update_weighted_norms(XZ, X.cols() + Fixed.cols());
+    }
 
-        // update weighted sum squares x / xz cols
-        idx = 0;
-        for (int k = 0; k < X.cols(); ++k, ++idx) {
-            if (strong_set[idx])
-                xv[idx] = std::pow(xs[idx], 2) * (X.col(k).cwiseProduct(X.col(k)) - 2 * xm[idx] * X.col(k) + std::pow(xm[idx], 2) * Eigen::VectorXd::Ones(n)).adjoint() * wgts;
+    // add contribution of strong features in x (numbered from offset) to
+    // the linear predictor
+    template <typename matType>
+    void add_linear_predictor(const matType & x, const int & offset) {
+        std::vector<int>::const_iterator it = std::lower_bound(strong_idx.begin(), strong_idx.end(), offset);
+        for (; it != strong_idx.end() && *it < offset + x.cols(); ++it) {
+            const int idx = *it;
+            betas_xbeta[idx] = betas[idx];
+            if (betas[idx] == 0.0) continue;
+            if (cache_slot[idx] >= 0) {
+                axpy_centered(betas[idx], cached_col(idx), 0.0, xbeta);
+            } else {
+                axpy_centered(xs[idx] * betas[idx], x.col(idx - offset), xm[idx], xbeta);
+            }
         }
-        for (int k = 0; k < Fixed.cols(); ++k, ++idx) {
-            if (strong_set[idx])
-                xv[idx] = std::pow(xs[idx], 2) * (Fixed.col(k).cwiseProduct(Fixed.col(k)) - 2 * xm[idx] * Fixed.col(k) + std::pow(xm[idx], 2) * Eigen::VectorXd::Ones(n)).adjoint() * wgts;
+    }
+
+    // add changes in estimates recorded since the last update (and removal
+    // of features that left the strong set) to the linear predictor
+    void update_linear_predictor() {
+        xbeta.array() += b0 - b0_xbeta;
+        for (std::size_t i = 0; i < changed_idx.size(); ++i) {
+            update_linear_predictor(changed_idx[i]);
         }
-        for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-            if (strong_set[idx])
-                xv[idx] = std::pow(xs[idx], 2) * (XZ.col(k).cwiseProduct(XZ.col(k)) - 2 * xm[idx] * XZ.col(k) + std::pow(xm[idx], 2) * Eigen::VectorXd::Ones(n)).adjoint() * wgts;
+        for (std::size_t i = 0; i < strong_left.size(); ++i) {
+            update_linear_predictor(strong_left[i]);
+        }
+    }
+
+    // add change in estimate of a single feature to the linear predictor
+    void update_linear_predictor(const int & idx) {
+        const double bk = strong_set[idx] ? betas[idx] : 0.0;
+        if (bk != betas_xbeta[idx]) {
+            standardized_axpy(idx, bk - betas_xbeta[idx], xbeta);
+            betas_xbeta[idx] = bk;
+        }
+    }
+
+    // weighted sum squares of strong features in x (numbered from offset),
+    // for inactive features with zero estimates they are refreshed by the
+    // coordinate update once the estimate moves
+    template <typename matType>
+    void update_weighted_norms(const matType & x, const int & offset) {
+        std::vector<int>::const_iterator it = std::lower_bound(strong_idx.begin(), strong_idx.end(), offset);
+        for (; it != strong_idx.end() && *it < offset + x.cols(); ++it) {
+            const int idx = *it;
+            if (!active_set[idx] && betas[idx] == 0.0) {
+                xv_stale[idx] = true;
+                continue;
+            }
+            xv_stale[idx] = false;
+            if (cache_slot[idx] >= 0) {
+                const MapVec ck = cached_col(idx);
+                xv[idx] = weighted_sum_squares(ck, 0.0, wgts, wgts_sum);
+                xw[idx] = dot_column(ck, wgts);
+            } else {
+                const auto xk = x.col(idx - offset);
+                xv[idx] = std::pow(xs[idx], 2) * weighted_sum_squares(xk, xm[idx], wgts, wgts_sum);
+                if (active_set[idx]) xw[idx] = xs[idx] * (dot_column(xk, wgts) - xm[idx] * wgts_sum);
+            }
         }
     }
 
+    // return to the weights at the bound of the hessian (and the weighted
+    // sum squares computed with them in init)
+    void bound_weights() {
+        bound_steps = true;
+        wgts_sum = 0.25;
+        wgts.array() = wgts_user.array() * wgts_sum;
+        xv = xv_bound;
+        update_weighted_norms(X, 0);
+        update_weighted_norms(Fixed, X.cols());
+        update_weighted_norms(XZ, X.cols() + Fixed.cols());
+        std::fill(xv_stale.begin(), xv_stale.end(), false);
+        select_kernel(true);
+    }
+
+    // switch from the bound to the true hessian once the bounded steps
+    // converge, a small bounded step does not imply a small distance to the
+    // solution when the curvature is well below the bound, so the fit is
+    // finished with IRLS steps
+    void exact_weights() {
+        bound_steps = false;
+        penalty_exact = penalty;
+        wgts.array() = wgts_user.array() * prob.array() * (1 - prob.array());
+        wgts_sum = wgts.sum();
+        update_weighted_norms(X, 0);
+        update_weighted_norms(Fixed, X.cols());
+        update_weighted_norms(XZ, X.cols() + Fixed.cols());
+        select_kernel(false);
+    }
+
     // check convergence of IRLS
     virtual bool converged() {
         bool converged_outer = true;
@@ -252,8 +392,9 @@ public:
                 converged_outer = false;
             }
             else {
-                for (int k = 0; k < nv_total; ++k) {
-                    if (strong_set[k] && xv[k] * std::pow(betas[k] - betas_prior[k], 2) > tolerance_irls) {
+                for (std::size_t i = 0; i < strong_idx.size(); ++i) {
+                    const int k = strong_idx[i];
+                    if (xv[k] * std::pow(betas[k] - betas_prior[k], 2) > tolerance_irls) {
                         converged_outer = false;
                         break;
                     }
@@ -262,36 +403,39 @@ public:
         }
         betas_prior = betas;
         b0_prior = b0;
+        if (converged_outer && bound_steps) {
+            exact_weights();
+            return false;
+        }
         return converged_outer;
     }
 
     // check kkt conditions
     virtual bool check_kkt() {
-        int num_violations = 0;
+        compute_gradient();
+        std::vector<int> new_idx;
         int idx = 0;
-        double resid_sum = residuals.sum();
         for (int k = 0; k < X.cols(); ++k, ++idx) {
-            if (!strong_set[idx]) {
-                gradient[idx] = xs[idx] * (X.col(k).dot(residuals) - xm[idx] * resid_sum);
-                if (std::abs(gradient[idx]) > penalty[0] * penalty_type[idx] * cmult[idx]) {
-                    strong_set[idx] = true;
-                    xv[idx] = std::pow(xs[idx], 2) * (X.col(k).cwiseProduct(X.col(k)) - 2 * xm[idx] * X.col(k) + std::pow(xm[idx], 2) * Eigen::VectorXd::Ones(n)).adjoint() * wgts;
-                    ++num_violations;
-                }
+            if (!strong_set[idx] && std::abs(gradient[idx]) > penalty[0] * penalty_type[idx] * cmult[idx]) {
+                strong_set[idx] = true;
+                new_idx.push_back(idx);
+                xv[idx] = std::pow(xs[idx], 2) * weighted_sum_squares(X.col(k), xm[idx], wgts, wgts_sum);
+                xv_stale[idx] = false;
             }
         }
         idx += Fixed.cols();
         for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-            if (!strong_set[idx]) {
-                gradient[idx] = xs[idx] * (XZ.col(k).dot(residuals) - xm[idx] * resid_sum);
-                if (std::abs(gradient[idx]) > penalty[1] * penalty_type[idx] * cmult[idx]) {
-                    strong_set[idx] = true;
-                    xv[idx] = std::pow(xs[idx], 2) * (XZ.col(k).cwiseProduct(XZ.col(k)) - 2 * xm[idx] * XZ.col(k) + std::pow(xm[idx], 2) * Eigen::VectorXd::Ones(n)).adjoint() * wgts;
-                    ++num_violations;
-                }
+            if (!strong_set[idx] && std::abs(gradient[idx]) > penalty[1] * penalty_type[idx] * cmult[idx]) {
+                strong_set[idx] = true;
+                new_idx.push_back(idx);
+                const auto xzk = XZ.col(k);
+                xv[idx] = std::pow(xs[idx], 2) * weighted_sum_squares(xzk, xm[idx], wgts, wgts_sum);
+                xv_stale[idx] = false;
             }
         }
-        return num_violations == 0;
+        const bool no_violations = new_idx.empty();
+        merge_strong(new_idx);
+        return no_violations;
     }
 };
 
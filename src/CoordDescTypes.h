@@ -1,9 +1,11 @@
 #ifndef COORD_DESC_TYPES_H
 #define COORD_DESC_TYPES_H
 
-#include <RcppEigen.h>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
 
 typedef Eigen::Map<const Eigen::MatrixXd> MapMat;
+typedef Eigen::Map<const Eigen::MatrixXf> MapMatF;
 typedef Eigen::MappedSparseMatrix<double> MapSpMat;
 typedef Eigen::Map<const Eigen::VectorXd> MapVec;
 
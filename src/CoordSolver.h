@@ -1,16 +1,24 @@
 #ifndef COORD_SOLVER_H
 #define COORD_SOLVER_H
 
-#include <RcppEigen.h>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <new>
 #include "DataFunctions.h"
-#include <bigmemory/MatrixAccessor.hpp>
-// [[Rcpp::depends(RcppEigen, BH, bigmemory)]]
+#include "XZMatrix.h"
+#include "Kernels.h"
 
 template <typename T>
 class CoordSolver {
 
     typedef Eigen::Map<const Eigen::MatrixXd> MapMat;
     typedef Eigen::MappedSparseMatrix<double> MapSpMat;
+    typedef Eigen::Matrix<typename T::Scalar, Eigen::Dynamic, Eigen::Dynamic> MatX;
     typedef Eigen::Map<const Eigen::VectorXd> MapVec;
     typedef Eigen::VectorXd VecXd;
     typedef Eigen::VectorXi VecXi;
@@ -23,7 +31,7 @@ protected:
     double ys;
     T X;
     MapMat Fixed;
-    MapMat XZ;
+    XZMatrix<T> XZ;
     MapVec penalty_type;
     MapVec cmult;
     const VecXd quantiles;
@@ -31,7 +39,7 @@ protected:
     MapVec lcl;
     const int ne;
     const int nx;
-    const double tolerance;
+    double tolerance;
     const int max_iterations;
     int num_passes;
     double dlx;
@@ -42,25 +50,55 @@ protected:
     Eigen::Map<const Eigen::VectorXd> xs;
     VecXd wgts_user;
     VecXd residuals;
+    double resids_sum;
     VecXd wgts;
     double wgts_sum;
+    VecXd xw;
     VecXd betas;
     VecXd betas_prior;
     VecXd gradient;
+    VecXd xtr;
+    VecXd xztr;
+    int num_threads;
     double b0;
     double b0_prior;
     const double tolerance_irls;
-    Rcpp::LogicalVector strong_set;
-    Rcpp::LogicalVector active_set;
+    std::vector<bool> strong_set;
+    std::vector<bool> active_set;
+    std::vector<bool> screened;
+    std::vector<int> screened_idx;
+    std::vector<int> strong_idx;
+    std::vector<int> strong_left;
+    std::vector<int> active_idx;
+    bool track_changes;
+    std::vector<bool> changed;
+    std::vector<int> changed_idx;
+    std::vector<bool> xv_stale;
+    bool use_working_set;
+    std::vector<bool> work_set;
+    std::vector<int> work_idx;
+    const int work_min_size = 32;
+    bool uniform_wgts;
+    bool unboxed;
+    bool use_anderson;
+    Eigen::MatrixXd anderson_iter;
+    int anderson_count;
+    const int anderson_depth = 5;
+    Eigen::MatrixXd active_cache;
+    std::vector<int> cache_slot;
+    std::vector<int> cache_free;
+    int cache_max_cols;
     int status;
     const double bigNum = 9.9e35;
+    const int newton_min_passes = 20;
+    const int newton_max_features = 500;
 
 public:
     // constructor (dense X matrix)
     CoordSolver(const Eigen::Ref<const Eigen::MatrixXd> & y_,
-                const Eigen::Ref<const Eigen::MatrixXd> & X_,
+                const Eigen::Ref<const MatX> & X_,
                 const Eigen::Ref<const Eigen::MatrixXd> & Fixed_,
-                const Eigen::Ref<const Eigen::MatrixXd> & XZ_,
+                const XZMatrix<T> & XZ_,
                 const double * xmptr,
                 double * xvptr,
                 const double * xsptr,
@@ -82,7 +120,7 @@ public:
     ys(1.0),
     X(X_.data(), n, X_.cols()),
     Fixed(Fixed_.data(), n, Fixed_.cols()),
-    XZ(XZ_.data(), n, XZ_.cols()),
+    XZ(XZ_),
     penalty_type(penalty_type_, nv_total),
     cmult(cmult_, nv_total),
     quantiles(quantiles_),
@@ -101,15 +139,32 @@ public:
     xs(xsptr, nv_total),
     wgts_user(wgts_user_),
     residuals(n),
+    resids_sum(0.0),
     wgts(n),
+    xw(nv_total),
     betas(nv_total),
     betas_prior(nv_total),
     gradient(nv_total),
+    xtr(X_.cols()),
+    xztr(XZ_.cols()),
+    num_threads(1),
     b0(0.0),
     b0_prior(0.0),
     tolerance_irls(tolerance_),
     strong_set(nv_total, false),
     active_set(nv_total, false),
+    screened(nv_total, false),
+    track_changes(false),
+    changed(nv_total, false),
+    xv_stale(nv_total, false),
+    use_working_set(false),
+    work_set(nv_total, false),
+    uniform_wgts(false),
+    unboxed(false),
+    use_anderson(false),
+    anderson_count(0),
+    cache_slot(nv_total, -1),
+    cache_max_cols(0),
     status(0)
     {
         init();
@@ -119,7 +174,7 @@ public:
     CoordSolver(const Eigen::Ref<const Eigen::MatrixXd> & y_,
                 const MapSpMat X_,
                 const Eigen::Ref<const Eigen::MatrixXd> & Fixed_,
-                const Eigen::Ref<const Eigen::MatrixXd> & XZ_,
+                const XZMatrix<T> & XZ_,
                 const double * xmptr,
                 double * xvptr,
                 const double * xsptr,
@@ -141,7 +196,7 @@ public:
         ys(1.0),
         X(X_),
         Fixed(Fixed_.data(), n, Fixed_.cols()),
-        XZ(XZ_.data(), n, XZ_.cols()),
+        XZ(XZ_),
         penalty_type(penalty_type_, nv_total),
         cmult(cmult_, nv_total),
         quantiles(quantiles_),
@@ -160,15 +215,32 @@ public:
         xs(xsptr, nv_total),
         wgts_user(wgts_user_),
         residuals(n),
+        resids_sum(0.0),
         wgts(n),
+        xw(nv_total),
         betas(nv_total),
         betas_prior(nv_total),
         gradient(nv_total),
+        xtr(X_.cols()),
+        xztr(XZ_.cols()),
+        num_threads(1),
         b0(0.0),
         b0_prior(0.0),
         tolerance_irls(tolerance_),
         strong_set(nv_total, false),
         active_set(nv_total, false),
+        screened(nv_total, false),
+        track_changes(false),
+        changed(nv_total, false),
+        xv_stale(nv_total, false),
+        use_working_set(false),
+        work_set(nv_total, false),
+        uniform_wgts(false),
+        unboxed(false),
+        use_anderson(false),
+        anderson_count(0),
+        cache_slot(nv_total, -1),
+        cache_max_cols(0),
         status(0)
     {
         init();
@@ -177,6 +249,10 @@ public:
     // destructor
     virtual ~CoordSolver(){};
 
+    // copy of the solver (same state and setup) whose weighted sum squares
+    // are copied to and updated in xvptr
+    virtual CoordSolver<T> * clone(double * xvptr) const = 0;
+
     // getters
     int getN(){return n;}
     int getNvar(){return nv_total;}
@@ -191,8 +267,8 @@ public:
     int getNumPasses(){return num_passes;}
     VecXd getGradient(){return gradient;}
     VecXd getCmult(){return cmult;}
-    Rcpp::LogicalVector getStrongSet(){return strong_set;}
-    Rcpp::LogicalVector getActiveSet(){return active_set;}
+    std::vector<bool> getStrongSet(){return strong_set;}
+    std::vector<bool> getActiveSet(){return active_set;}
     int getStatus(){return status;}
     double getYm(){return ym;}
     double getYs(){return ys;}
@@ -200,6 +276,12 @@ public:
     // setters
     void setPenalty(double val, int pos) {penalty[pos] = val;}
     void setBetas(const Eigen::Ref<const Eigen::VectorXd> & betas_) {betas = betas_;}
+    void setNumThreads(int val) {num_threads = std::max(1, val);}
+    void setWorkingSet(bool val) {use_working_set = val;}
+    void setAnderson(bool val) {use_anderson = val;}
+    void setCacheSize(double megabytes) {
+        cache_max_cols = static_cast<int>(std::min(megabytes * 1048576.0 / (8.0 * n), static_cast<double>(nv_total)));
+    }
 
     // solve GLM CD problem
     void solve() {
@@ -215,90 +297,508 @@ public:
         }
     }
 
-    // coord desc to solve weighted linear regularized regression
+    // coord desc to solve weighted linear regularized regression, passes
+    // cover the strong set or, in working set mode, the working set, which
+    // grows until no strong feature outside it violates the kkt conditions
     void coord_desc() {
+        const int offset_fixed = X.cols();
+        const int offset_xz = X.cols() + Fixed.cols();
+        const std::vector<int> & pass_idx = use_working_set ? work_idx : strong_idx;
         while (num_passes < max_iterations) {
             dlx = 0.0;
-            int idx = 0;
-            update_beta_screen(X, penalty[0], idx);
-            update_beta_screen(Fixed, penalty[0], idx);
-            update_beta_screen(XZ, penalty[1], idx);
+            update_beta(X, penalty[0], 0, pass_idx);
+            update_beta(Fixed, penalty[0], offset_fixed, pass_idx);
+            update_beta(XZ, penalty[1], offset_xz, pass_idx);
+            if (intercept) update_intercept();
+            ++num_passes;
+            if (dlx < tolerance) {
+                if (use_working_set && grow_working()) continue;
+                break;
+            }
+            solve_active();
+        }
+    }
+
+    // kkt violation of a zero estimate of feature idx with gradient gk
+    // (positive if violated)
+    double kkt_violation(const int & idx, const double & gk) const {
+        const double lam = idx < X.cols() + Fixed.cols() ? penalty[0] : penalty[1];
+        return std::abs(gk) - lam * penalty_type[idx] * cmult[idx];
+    }
+
+    // start the working set of a new penalty from the unpenalized and
+    // active strong features and the strong features with the largest kkt
+    // violations (gradient must be up to date with the residuals)
+    void init_working() {
+        for (std::size_t k = 0; k < work_idx.size(); ++k) {
+            work_set[work_idx[k]] = false;
+        }
+        work_idx.clear();
+        std::vector<std::pair<double, int> > candidates;
+        for (std::size_t k = 0; k < strong_idx.size(); ++k) {
+            const int idx = strong_idx[k];
+            if (active_set[idx] || cmult[idx] == 0.0) {
+                work_set[idx] = true;
+                work_idx.push_back(idx);
+            } else {
+                const double viol = kkt_violation(idx, gradient[idx]);
+                if (viol > 0.0) candidates.push_back(std::make_pair(viol, idx));
+            }
+        }
+        add_working(candidates, std::max(work_min_size, static_cast<int>(work_idx.size())));
+    }
+
+    // add the strong features outside the working set with the largest kkt
+    // violations at the current residuals, at most doubling its size,
+    // returns false if there are none
+    bool grow_working() {
+        if (work_idx.size() == strong_idx.size()) return false;
+        std::vector<std::pair<double, int> > candidates;
+        for (std::size_t k = 0; k < strong_idx.size(); ++k) {
+            const int idx = strong_idx[k];
+            if (work_set[idx]) continue;
+            const double viol = kkt_violation(idx, standardized_dot(idx, residuals, resids_sum));
+            if (viol > 0.0) candidates.push_back(std::make_pair(viol, idx));
+        }
+        if (candidates.empty()) return false;
+        add_working(candidates, std::max(work_min_size, static_cast<int>(work_idx.size())));
+        return true;
+    }
+
+    // merge the (at most max_add) candidates with the largest violations
+    // into the ordered working set index list
+    void add_working(std::vector<std::pair<double, int> > & candidates, const int & max_add) {
+        if (static_cast<int>(candidates.size()) > max_add) {
+            std::nth_element(candidates.begin(), candidates.begin() + max_add, candidates.end(),
+                             std::greater<std::pair<double, int> >());
+            candidates.resize(max_add);
+        }
+        std::vector<int> new_idx;
+        for (std::size_t k = 0; k < candidates.size(); ++k) {
+            work_set[candidates[k].second] = true;
+            new_idx.push_back(candidates[k].second);
+        }
+        std::sort(new_idx.begin(), new_idx.end());
+        const std::size_t old_size = work_idx.size();
+        work_idx.insert(work_idx.end(), new_idx.begin(), new_idx.end());
+        std::inplace_merge(work_idx.begin(), work_idx.begin() + old_size, work_idx.end());
+    }
+
+    // repeated passes over the active set until convergence
+    // (a newton step is tried if coordinate descent converges slowly, and
+    // passes are extrapolated if anderson acceleration is used)
+    virtual void solve_active() {
+        const int offset_fixed = X.cols();
+        const int offset_xz = X.cols() + Fixed.cols();
+        int passes = 0;
+        anderson_count = 0;
+        while (num_passes < max_iterations) {
+            dlx = 0.0;
+            update_beta(X, penalty[0], 0, active_idx);
+            update_beta(Fixed, penalty[0], offset_fixed, active_idx);
+            update_beta(XZ, penalty[1], offset_xz, active_idx);
             if (intercept) update_intercept();
             ++num_passes;
             if (dlx < tolerance) break;
-            while (num_passes < max_iterations) {
-                dlx = 0.0;
-                idx = 0;
-                update_beta_active(X, penalty[0], idx);
-                update_beta_active(Fixed, penalty[0], idx);
-                update_beta_active(XZ, penalty[1], idx);
-                if (intercept) update_intercept();
-                ++num_passes;
-                if (dlx < tolerance) break;
+            if (use_anderson) anderson_step();
+            if (++passes == newton_passes() && newton_step()) anderson_count = 0;
+        }
+    }
+
+    // store the active estimates after a pass and, once anderson_depth + 1
+    // passes are stored, move to their extrapolation if it lowers the
+    // objective of the weighted least squares problem
+    bool anderson_step() {
+        VecXd d;
+        if (!anderson_extrapolate(d)) return false;
+        const int m = active_idx.size();
+
+        // change in fitted values and in the objective
+        VecXd v = VecXd::Constant(n, d[m]);
+        for (int a = 0; a < m; ++a) {
+            if (d[a] != 0.0) standardized_axpy(active_idx[a], d[a], v);
+        }
+        const double dloss = 0.5 * (wgts.array() * v.array().square()).sum() - residuals.dot(v);
+        if (dloss + anderson_penalty(d) >= 0.0) return false;
+
+        for (int a = 0; a < m; ++a) {
+            betas[active_idx[a]] += d[a];
+            if (d[a] != 0.0) mark_changed(active_idx[a]);
+        }
+        b0 += d[m];
+        residuals.array() -= wgts.array() * v.array();
+        resids_sum = residuals.sum();
+        return true;
+    }
+
+    // record the active estimates (and intercept) after a pass, and the
+    // anderson extrapolation d (as a change from the current estimates)
+    // when enough passes are stored, the weights of the last anderson_depth
+    // iterates sum to one and minimize the norm of their combined
+    // differences, returns false if no extrapolation is available or it
+    // leaves the limits of any estimate
+    bool anderson_extrapolate(VecXd & d) {
+        const int m = active_idx.size();
+        if (anderson_count == 0) anderson_iter.resize(m + 1, anderson_depth + 1);
+        for (int a = 0; a < m; ++a) {
+            anderson_iter(a, anderson_count) = betas[active_idx[a]];
+        }
+        anderson_iter(m, anderson_count) = b0;
+        if (++anderson_count <= anderson_depth) return false;
+        anderson_count = 0;
+
+        const Eigen::MatrixXd U = anderson_iter.rightCols(anderson_depth) -
+            anderson_iter.leftCols(anderson_depth);
+        const Eigen::MatrixXd UtU = U.transpose() * U;
+        Eigen::LDLT<Eigen::MatrixXd> ldlt(UtU);
+        if (ldlt.info() != Eigen::Success) return false;
+        VecXd c = ldlt.solve(VecXd::Ones(anderson_depth));
+        if (!c.allFinite() || c.sum() == 0.0) return false;
+        c /= c.sum();
+        d = anderson_iter.rightCols(anderson_depth) * c - anderson_iter.col(anderson_depth);
+        if (!intercept) d[m] = 0.0;
+        if (!d.allFinite()) return false;
+        for (int a = 0; a < m; ++a) {
+            const double bk = betas[active_idx[a]] + d[a];
+            if (bk < lcl[active_idx[a]] || bk > ucl[active_idx[a]]) return false;
+        }
+        return true;
+    }
+
+    // change in the penalty of the active features when their estimates
+    // move by d
+    double anderson_penalty(const VecXd & d) const {
+        const int offset_xz = X.cols() + Fixed.cols();
+        double dpen = 0.0;
+        for (std::size_t a = 0; a < active_idx.size(); ++a) {
+            const int idx = active_idx[a];
+            const double lam = cmult[idx] * (idx < offset_xz ? penalty[0] : penalty[1]);
+            const double bk = betas[idx] + d[a];
+            dpen += lam * (penalty_type[idx] * (std::abs(bk) - std::abs(betas[idx])) +
+                0.5 * (1 - penalty_type[idx]) * (bk * bk - betas[idx] * betas[idx]));
+        }
+        return dpen;
+    }
+
+    // passes over the active set before a newton step is tried, large enough
+    // that building the hessian costs at most as much as the passes made
+    int newton_passes() const {
+        return std::max(newton_min_passes, static_cast<int>(active_idx.size()));
+    }
+
+    // active features with nonzero estimates strictly inside their limits,
+    // the free variables of a newton step
+    void newton_features(std::vector<int> & free_idx) const {
+        free_idx.clear();
+        for (std::size_t a = 0; a < active_idx.size(); ++a) {
+            const int idx = active_idx[a];
+            if (betas[idx] != 0.0 && betas[idx] > lcl[idx] && betas[idx] < ucl[idx]) {
+                free_idx.push_back(idx);
             }
         }
     }
 
-    // coordinatewise update of features in strong set
-    template <typename matType>
-    void update_beta_screen(const matType & x, const double & lam, int & idx) {
-        for (int k = 0; k < x.cols(); ++k, ++idx) {
-            if (strong_set[idx]) {
-                double gk = xs[idx] * (x.col(k).dot(residuals) - xm[idx] * residuals.sum());
-                double bk = betas[idx];
-                double grad = gk + bk * xv[idx];
-                double grad_thresh = std::abs(grad) - cmult[idx] * penalty_type[idx] * lam;
-                if (grad_thresh > 0.0) {
-                    betas[idx] = std::max(lcl[idx],
-                                          std::min(ucl[idx],
-                                          copysign(grad_thresh, grad) / (xv[idx] + cmult[idx] * (1 - penalty_type[idx]) * lam)));
-                }
-                else {
-                    betas[idx] = 0.0;
-                }
-                if (betas[idx] != bk) {
-                    double del = betas[idx] - bk;
-                    if (!active_set[idx]) {
-                        active_set[idx] = true;
-                    }
-                    residuals -= del * xs[idx] * (x.col(k) - xm[idx]  * Eigen::VectorXd::Ones(n)).cwiseProduct(wgts);
-                    dlx = std::max(dlx, xv[idx] * del * del);
-                }
+    // newton direction d for the features in free_idx (and the intercept in
+    // the last position) given the hessian H and gradient g of the weighted
+    // least squares loss, signs of the estimates are held fixed so the
+    // penalty is smooth, returns false if the solution changes a sign or
+    // leaves the limits of any estimate
+    bool newton_direction(const std::vector<int> & free_idx,
+                          Eigen::MatrixXd & H,
+                          VecXd & g,
+                          VecXd & d) const {
+        const int offset_xz = X.cols() + Fixed.cols();
+        for (std::size_t k = 0; k < free_idx.size(); ++k) {
+            const int idx = free_idx[k];
+            const double lam = cmult[idx] * (idx < offset_xz ? penalty[0] : penalty[1]);
+            H(k, k) += (1 - penalty_type[idx]) * lam;
+            g[k] -= (1 - penalty_type[idx]) * lam * betas[idx] + copysign(penalty_type[idx] * lam, betas[idx]);
+        }
+        Eigen::LDLT<Eigen::MatrixXd> ldlt(H);
+        if (ldlt.info() != Eigen::Success || !ldlt.isPositive()) return false;
+        d = ldlt.solve(g);
+        if (!d.allFinite()) return false;
+        for (std::size_t k = 0; k < free_idx.size(); ++k) {
+            const int idx = free_idx[k];
+            const double bk = betas[idx] + d[k];
+            if (!(bk * betas[idx] > 0.0) || bk <= lcl[idx] || bk >= ucl[idx]) return false;
+        }
+        return true;
+    }
+
+    // solve the quadratic approximation restricted to the free active
+    // features with a newton step, estimates are left unchanged if the step
+    // is rejected (features at zero or at a limit are fixed, the next
+    // coordinate descent pass checks them)
+    bool newton_step() {
+        std::vector<int> free_idx;
+        newton_features(free_idx);
+        const int m = free_idx.size();
+        if (m == 0 || m > newton_max_features) return false;
+
+        // hessian and gradient of the weighted least squares loss
+        const int dim = m + intercept;
+        Eigen::MatrixXd H(dim, dim);
+        VecXd g(dim);
+        VecXd col(n);
+        for (int k = 0; k < m; ++k) {
+            standardized_col(free_idx[k], col);
+            col.array() *= wgts.array();
+            const double col_sum = col.sum();
+            for (int j = 0; j <= k; ++j) {
+                H(j, k) = standardized_dot(free_idx[j], col, col_sum);
+                H(k, j) = H(j, k);
             }
+            g[k] = standardized_dot(free_idx[k], residuals, resids_sum);
+            if (intercept) {
+                H(m, k) = xw[free_idx[k]];
+                H(k, m) = H(m, k);
+            }
+        }
+        if (intercept) {
+            H(m, m) = wgts_sum;
+            g[m] = resids_sum;
+        }
+
+        VecXd d;
+        if (!newton_direction(free_idx, H, g, d)) return false;
+        for (int k = 0; k < m; ++k) {
+            const int idx = free_idx[k];
+            betas[idx] += d[k];
+            mark_changed(idx);
+            standardized_col(idx, col);
+            axpy_centered_weighted(-d[k], col, 0.0, wgts, residuals);
+            resids_sum -= d[k] * xw[idx];
+            dlx = std::max(dlx, xv[idx] * d[k] * d[k]);
         }
+        if (intercept) {
+            b0 += d[m];
+            residuals.noalias() -= d[m] * wgts;
+            resids_sum -= d[m] * wgts_sum;
+            dlx = std::max(dlx, d[m] * d[m] * wgts_sum);
+        }
+        return true;
+    }
+
+    // choose the coordinate update kernel once the weights are set, weights
+    // are uniform when they are equal across observations and stay fixed
+    // (fixed_wgts), and estimates are unboxed when no limits are finite
+    void select_kernel(const bool & fixed_wgts) {
+        uniform_wgts = fixed_wgts && n > 0 && (wgts.array() == wgts[0]).all();
+        unboxed = lcl.array().isInf().all() && ucl.array().isInf().all();
     }
 
-    // coordinatewise update of features in active set
+    // coordinatewise update of features of x in the ordered index list
+    // set_idx (strong or active set), x holds the features numbered from
+    // offset, dispatched to the kernel specialized for the weights and limits
     template <typename matType>
-    void update_beta_active(const matType & x, const double & lam, int & idx) {
-        for (int k = 0; k < x.cols(); ++k, ++idx) {
-            if (active_set[idx]) {
-                double gk = xs[idx] * (x.col(k).dot(residuals) - xm[idx] * residuals.sum());
-                double bk = betas[idx];
-                double grad = gk + bk * xv[idx];
-                double grad_thresh = std::abs(grad) - cmult[idx] * penalty_type[idx] * lam;
-                if (grad_thresh > 0.0) {
-                    betas[idx] = std::max(lcl[idx],
-                                          std::min(ucl[idx],
-                                          copysign(grad_thresh, grad) / (xv[idx] + cmult[idx] * (1 - penalty_type[idx]) * lam)));
-                }
-                else {
-                    betas[idx] = 0.0;
-                }
-                if (betas[idx] != bk) {
-                    double del = betas[idx] - bk;
-                    residuals -= del * xs[idx] * (x.col(k) - xm[idx] * Eigen::VectorXd::Ones(n)).cwiseProduct(wgts);
-                    dlx = std::max(dlx, xv[idx] * del * del);
-                }
+    void update_beta(const matType & x, const double & lam, const int & offset,
+                     const std::vector<int> & set_idx) {
+        if (uniform_wgts) {
+            if (unboxed) {
+                update_beta<true, false>(x, lam, offset, set_idx);
+            } else {
+                update_beta<true, true>(x, lam, offset, set_idx);
+            }
+        } else {
+            if (unboxed) {
+                update_beta<false, false>(x, lam, offset, set_idx);
+            } else {
+                update_beta<false, true>(x, lam, offset, set_idx);
+            }
+        }
+    }
+
+    template <bool Uniform, bool Boxed, typename matType>
+    void update_beta(const matType & x, const double & lam, const int & offset,
+                     const std::vector<int> & set_idx) {
+        std::vector<int>::const_iterator it = std::lower_bound(set_idx.begin(), set_idx.end(), offset);
+        for (; it != set_idx.end() && *it < offset + x.cols(); ++it) {
+            const int idx = *it;
+            if (cache_slot[idx] >= 0) {
+                update_coordinate<Uniform, Boxed>(cached_col(idx), 1.0, 0.0, lam, idx);
+            } else {
+                update_coordinate<Uniform, Boxed>(x.col(idx - offset), xs[idx], xm[idx], lam, idx);
+            }
+        }
+    }
+
+    // coordinatewise update of feature idx given its column xk, standardized
+    // as scale * (xk - center), with uniform weights the residuals are
+    // updated without reading the weights
+    template <bool Uniform, bool Boxed, typename colType>
+    void update_coordinate(const colType & xk, const double & scale,
+                           const double & center, const double & lam,
+                           const int & idx) {
+        double gk = scale * (dot_column(xk, residuals) - center * resids_sum);
+        if (xv_stale[idx]) {
+            // weighted sum squares of a feature are only refreshed once its
+            // estimate is nonzero or moves from zero
+            if (betas[idx] == 0.0 && std::abs(gk) <= cmult[idx] * penalty_type[idx] * lam) return;
+            xv[idx] = scale * scale * weighted_sum_squares(xk, center, wgts, wgts_sum);
+            xv_stale[idx] = false;
+        }
+        double bk = betas[idx];
+        betas[idx] = update_estimate<Boxed>(idx, gk, lam);
+        if (betas[idx] != bk) {
+            double del = betas[idx] - bk;
+            mark_changed(idx);
+            if (!active_set[idx]) {
+                add_active(idx);
+                xw[idx] = scale * (dot_column(xk, wgts) - center * wgts_sum);
+                cache_column(xk, idx);
+            }
+            if (Uniform) {
+                axpy_centered(-del * scale * wgts[0], xk, center, residuals);
+            } else {
+                axpy_centered_weighted(-del * scale, xk, center, wgts, residuals);
+            }
+            resids_sum -= del * xw[idx];
+            dlx = std::max(dlx, xv[idx] * del * del);
+        }
+    }
+
+    // penalized (and box constrained unless Boxed is false) estimate of
+    // feature idx given its partial gradient gk at the current estimate
+    template <bool Boxed = true>
+    double update_estimate(const int & idx, const double & gk, const double & lam) const {
+        double grad = gk + betas[idx] * xv[idx];
+        double grad_thresh = std::abs(grad) - cmult[idx] * penalty_type[idx] * lam;
+        if (grad_thresh > 0.0) {
+            const double bk = copysign(grad_thresh, grad) / (xv[idx] + cmult[idx] * (1 - penalty_type[idx]) * lam);
+            return Boxed ? std::max(lcl[idx], std::min(ucl[idx], bk)) : bk;
+        }
+        return 0.0;
+    }
+
+    // write standardized column xs * (x - xm) of feature idx to out
+    void standardized_col(const int & idx, Eigen::Ref<VecXd> out) const {
+        if (cache_slot[idx] >= 0) {
+            out = cached_col(idx);
+            return;
+        }
+        out.setZero();
+        standardized_axpy(idx, 1.0, out);
+    }
+
+    // out += a * standardized column of feature idx
+    void standardized_axpy(const int & idx, const double & a, Eigen::Ref<VecXd> out) const {
+        if (cache_slot[idx] >= 0) {
+            axpy_centered(a, cached_col(idx), 0.0, out);
+            return;
+        }
+        const int offset_xz = X.cols() + Fixed.cols();
+        if (idx < X.cols()) {
+            axpy_centered(a * xs[idx], X.col(idx), xm[idx], out);
+        } else if (idx < offset_xz) {
+            axpy_centered(a * xs[idx], Fixed.col(idx - X.cols()), xm[idx], out);
+        } else {
+            axpy_centered(a * xs[idx], XZ.col(idx - offset_xz), xm[idx], out);
+        }
+    }
+
+    // standardized_col(idx)^T * v, v_sum is the sum of v
+    double standardized_dot(const int & idx,
+                            const Eigen::Ref<const VecXd> & v,
+                            const double & v_sum) const {
+        if (cache_slot[idx] >= 0) {
+            return dot_column(cached_col(idx), v);
+        }
+        const int offset_xz = X.cols() + Fixed.cols();
+        if (idx < X.cols()) {
+            return xs[idx] * (dot_column(X.col(idx), v) - xm[idx] * v_sum);
+        } else if (idx < offset_xz) {
+            return xs[idx] * (dot_column(Fixed.col(idx - X.cols()), v) - xm[idx] * v_sum);
+        }
+        return xs[idx] * (dot_column(XZ.col(idx - offset_xz), v) - xm[idx] * v_sum);
+    }
+
+    // standardized column of a cached feature
+    MapVec cached_col(const int & idx) const {
+        return MapVec(active_cache.data() + static_cast<std::ptrdiff_t>(n) * cache_slot[idx], n);
+    }
+
+    // copy standardized dense column of a new active feature into the packed
+    // cache, until the cache reaches its maximum size
+    template <typename Derived>
+    void cache_column(const Eigen::MatrixBase<Derived> & xk, const int & idx) {
+        if (cache_free.empty()) {
+            const int num_cols = active_cache.cols();
+            if (num_cols >= cache_max_cols) return;
+            const int new_cols = std::min(cache_max_cols, std::max(8, 2 * num_cols));
+            active_cache.conservativeResize(n, new_cols);
+            for (int j = new_cols - 1; j >= num_cols; --j) cache_free.push_back(j);
+        }
+        const int slot = cache_free.back();
+        cache_free.pop_back();
+        active_cache.col(slot).array() = xs[idx] * (xk.derived().template cast<double>().array() - xm[idx]);
+        cache_slot[idx] = slot;
+    }
+
+    // sparse columns are not cached
+    template <typename Derived>
+    void cache_column(const Eigen::SparseMatrixBase<Derived> & /* xk */, const int & /* idx */) {}
+
+    // return cache slot of a feature leaving the active set
+    void release_column(const int & idx) {
+        if (cache_slot[idx] >= 0) {
+            cache_free.push_back(cache_slot[idx]);
+            cache_slot[idx] = -1;
+        }
+    }
+
+    // add feature to active set (membership flag and ordered index list)
+    void add_active(const int & idx) {
+        active_set[idx] = true;
+        active_idx.insert(std::lower_bound(active_idx.begin(), active_idx.end(), idx), idx);
+    }
+
+    // record a change in the estimate of feature idx (if changes are
+    // tracked, e.g. to update the linear predictor of binomial solvers)
+    void mark_changed(const int & idx) {
+        if (track_changes && !changed[idx]) {
+            changed[idx] = true;
+            changed_idx.push_back(idx);
+        }
+    }
+
+    // forget recorded changes in estimates
+    void clear_changed() {
+        for (std::size_t k = 0; k < changed_idx.size(); ++k) {
+            changed[changed_idx[k]] = false;
+        }
+        changed_idx.clear();
+    }
+
+    // merge features newly flagged in strong_set (new_idx, in increasing
+    // order) into the ordered strong index list
+    void merge_strong(std::vector<int> & new_idx) {
+        if (new_idx.empty()) return;
+        const std::size_t old_size = strong_idx.size();
+        strong_idx.insert(strong_idx.end(), new_idx.begin(), new_idx.end());
+        std::inplace_merge(strong_idx.begin(), strong_idx.begin() + old_size, strong_idx.end());
+        new_idx.clear();
+    }
+
+    // add features (given in increasing order) to the strong set
+    void seed_strong(const Eigen::Ref<const Eigen::VectorXi> & seed_idx) {
+        std::vector<int> new_idx;
+        for (int k = 0; k < seed_idx.size(); ++k) {
+            const int idx = seed_idx[k];
+            if (!strong_set[idx] && (!screened[idx] || betas[idx] != 0.0)) {
+                strong_set[idx] = true;
+                new_idx.push_back(idx);
             }
         }
+        merge_strong(new_idx);
     }
 
     // update intercept
     void update_intercept(){
-        double del = residuals.sum() / wgts_sum;
+        double del = resids_sum / wgts_sum;
         b0 += del;
         residuals.array() -= del * wgts.array();
+        resids_sum -= del * wgts_sum;
         dlx = std::max(dlx, del * del * wgts_sum);
     }
 
@@ -306,6 +806,7 @@ public:
     void init(){
         betas = Eigen::VectorXd::Zero(nv_total);
         betas_prior = Eigen::VectorXd::Zero(nv_total);
+        gradient = Eigen::VectorXd::Zero(nv_total);
 
         // add fixed vars to strong set
         std::fill(
@@ -313,6 +814,15 @@ public:
             strong_set.begin() + X.cols() + Fixed.cols(),
             true
         );
+        for (int k = 0; k < Fixed.cols(); ++k) {
+            strong_idx.push_back(X.cols() + k);
+        }
+    }
+
+    // copy weighted sum squares to xvptr and map xv onto the copy
+    void rebind_xv(double * xvptr) {
+        std::copy(xv.data(), xv.data() + nv_total, xvptr);
+        new (&xv) Eigen::Map<Eigen::VectorXd>(xvptr, nv_total);
     }
 
     // warm start initialization given current estimates
@@ -327,88 +837,176 @@ public:
         int idx = 0;
         residuals.array() = wgts.array() * ((y.col(0).array() - ym) / ys - b0);
         for (int k = 0; k < X.cols(); ++k, ++idx) {
-            residuals -= betas[idx] * xs[idx] * (X.col(k) - xm[idx]  * Eigen::VectorXd::Ones(n)).cwiseProduct(wgts);
+            if (betas[idx] != 0.0) {
+                axpy_centered_weighted(-betas[idx] * xs[idx], X.col(k), xm[idx], wgts, residuals);
+            }
         }
         for (int k = 0; k < Fixed.cols(); ++k, ++idx) {
-            residuals -= betas[idx] * xs[idx] * (Fixed.col(k) - xm[idx]  * Eigen::VectorXd::Ones(n)).cwiseProduct(wgts);
+            if (betas[idx] != 0.0) {
+                axpy_centered_weighted(-betas[idx] * xs[idx], Fixed.col(k), xm[idx], wgts, residuals);
+            }
         }
         for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-            residuals -= betas[idx] * xs[idx] * (XZ.col(k) - xm[idx]  * Eigen::VectorXd::Ones(n)).cwiseProduct(wgts);
+            if (betas[idx] != 0.0) {
+                axpy_centered_weighted(-betas[idx] * xs[idx], XZ.col(k), xm[idx], wgts, residuals);
+            }
         }
 
         // compute gradients given current residuals (penalized features only)
-        idx = 0;
-        double resids_sum = residuals.sum();
-        for (int k = 0; k < X.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (X.col(k).dot(residuals) - xm[idx] * resids_sum);
+        compute_gradient();
+    }
+
+    // gradient of all features given current residuals
+    void compute_gradient() {
+        resids_sum = residuals.sum();
+        standardized_crossprod(residuals, resids_sum, gradient);
+    }
+
+    // empty the screened set (gradients of all features, screened or not,
+    // are kept up to date by the blocked sweeps of the kkt checks)
+    void clear_screened() {
+        for (std::size_t k = 0; k < screened_idx.size(); ++k) {
+            screened[screened_idx[k]] = false;
         }
-        idx += Fixed.cols();
-        for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (XZ.col(k).dot(residuals) - xm[idx] * resids_sum);
+        screened_idx.clear();
+    }
+
+    // out = standardized columns of all features times v (v_sum is the sum
+    // of v), X^T v is computed in one blocked sweep and the XZ products are
+    // derived from it when XZ is implicit
+    void standardized_crossprod(const Eigen::Ref<const VecXd> & v,
+                                const double & v_sum,
+                                Eigen::Ref<VecXd> out) {
+        const int nv_x = X.cols();
+        const int nv_fixed = Fixed.cols();
+        const int nv_xz = XZ.cols();
+        crossprod(X, v, xtr, num_threads);
+        out.head(nv_x).array() = xs.head(nv_x).array() *
+            (xtr.array() - xm.head(nv_x).array() * v_sum);
+        if (nv_fixed > 0) {
+            out.segment(nv_x, nv_fixed).array() = xs.segment(nv_x, nv_fixed).array() *
+                ((Fixed.transpose() * v).array() - xm.segment(nv_x, nv_fixed).array() * v_sum);
+        }
+        if (nv_xz > 0) {
+            XZ.crossprod(v, xtr, v_sum, xztr);
+            out.tail(nv_xz).array() = xs.tail(nv_xz).array() *
+                (xztr.array() - xm.tail(nv_xz).array() * v_sum);
         }
     }
 
     // update quadratic approx. of likelihood function
-    // (linear case has no update)
-    virtual void update_quadratic(){}
+    // (linear case has no update, nor a linear predictor tracking strong_left)
+    virtual void update_quadratic(){strong_left.clear();}
 
     // check convergence of IRLS (always converged in linear case)
     virtual bool converged() {return true;}
 
+    // safe screening of features at the current penalty, features marked in
+    // screened have zero estimates at the solution and are kept out of the
+    // strong set while the penalty is unchanged (only implemented for the
+    // linear case)
+    virtual void safe_screen() {}
+
     // update strong set
     void update_strong(const Eigen::Ref<const VecXd> & path,
                        const Eigen::Ref<const VecXd> & path_ext,
                        const int & m,
                        const int & m2) {
+        safe_screen();
         int idx = 0;
-        double penalty_old = (m == 0 || (m == 1 && path[m - 1] == bigNum)) ? 0.0 : path[m - 1];
-        double lam_diff = 2.0 * path[m] - penalty_old;
+        std::vector<int> new_idx;
+        double lam_diff = 2.0 * path[m] - strong_penalty_old(path, m - 1);
         for (int k = 0; k < X.cols(); ++k, ++idx) {
-            if (!strong_set[idx]) {
-                strong_set[idx] = std::abs(gradient[idx]) > lam_diff * penalty_type[idx] * cmult[idx];
+            if (!strong_set[idx] && !screened[idx] && std::abs(gradient[idx]) > lam_diff * penalty_type[idx] * cmult[idx]) {
+                strong_set[idx] = true;
+                new_idx.push_back(idx);
             }
         }
         idx += Fixed.cols();
         if (XZ.cols() > 0) {
             if (m2 == 0) {
-                std::fill(strong_set.begin() + X.cols() + Fixed.cols(), strong_set.end(), false);
-                std::fill(active_set.begin() + X.cols() + Fixed.cols(), active_set.end(), false);
+                std::fill(strong_set.begin() + idx, strong_set.end(), false);
+                std::fill(active_set.begin() + idx, active_set.end(), false);
+                std::vector<int>::iterator it_xz = std::lower_bound(active_idx.begin(), active_idx.end(), idx);
+                for (std::vector<int>::iterator it = it_xz; it != active_idx.end(); ++it) {
+                    release_column(*it);
+                }
+                active_idx.erase(it_xz, active_idx.end());
+                std::vector<int>::iterator it_strong = std::lower_bound(strong_idx.begin(), strong_idx.end(), idx);
+                strong_left.insert(strong_left.end(), it_strong, strong_idx.end());
+                strong_idx.erase(it_strong, strong_idx.end());
             }
-            penalty_old = (m2 == 0 || (m2 == 1 && path[m2 - 1] == bigNum)) ? 0.0 : path[m2 - 1];;
-            lam_diff = 2.0 * path_ext[m2] - penalty_old;
+            lam_diff = 2.0 * path_ext[m2] - strong_penalty_old(path_ext, m2 - 1);
             for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-                if (!strong_set[idx]) {
-                    strong_set[idx] = std::abs(gradient[idx]) > lam_diff * penalty_type[idx] * cmult[idx];
+                if (!strong_set[idx] && !screened[idx] && std::abs(gradient[idx]) > lam_diff * penalty_type[idx] * cmult[idx]) {
+                    strong_set[idx] = true;
+                    new_idx.push_back(idx);
                 }
             }
         }
+        merge_strong(new_idx);
+        if (use_working_set) init_working();
     }
 
-    // check kkt conditions
+    // update strong set for penalties (m, m2) starting from the solution at
+    // the neighbouring grid point (m_prev, m2_prev) of a serpentine traversal
+    // of the grid, the strong and active sets of both levels are kept
+    void update_strong(const Eigen::Ref<const VecXd> & path,
+                       const Eigen::Ref<const VecXd> & path_ext,
+                       const int & m,
+                       const int & m2,
+                       const int & m_prev,
+                       const int & m2_prev) {
+        safe_screen();
+        int idx = 0;
+        std::vector<int> new_idx;
+        double lam_diff = 2.0 * path[m] - strong_penalty_old(path, m_prev);
+        for (int k = 0; k < X.cols(); ++k, ++idx) {
+            if (!strong_set[idx] && !screened[idx] && std::abs(gradient[idx]) > lam_diff * penalty_type[idx] * cmult[idx]) {
+                strong_set[idx] = true;
+                new_idx.push_back(idx);
+            }
+        }
+        idx += Fixed.cols();
+        lam_diff = 2.0 * path_ext[m2] - strong_penalty_old(path_ext, m2_prev);
+        for (int k = 0; k < XZ.cols(); ++k, ++idx) {
+            if (!strong_set[idx] && !screened[idx] && std::abs(gradient[idx]) > lam_diff * penalty_type[idx] * cmult[idx]) {
+                strong_set[idx] = true;
+                new_idx.push_back(idx);
+            }
+        }
+        merge_strong(new_idx);
+        if (use_working_set) init_working();
+    }
+
+    // previous penalty in the sequential strong rule, 0 for the first grid
+    // point or when it is the placeholder for the largest penalty
+    double strong_penalty_old(const Eigen::Ref<const VecXd> & path, const int & k) const {
+        return (k < 0 || path[k] == bigNum) ? 0.0 : path[k];
+    }
+
+    // check kkt conditions (screened features cannot violate them), the
+    // gradient comes from one blocked sweep over all columns
     virtual bool check_kkt() {
-        int num_violations = 0;
+        compute_gradient();
+        std::vector<int> new_idx;
         int idx = 0;
-        double resid_sum = residuals.sum();
         for (int k = 0; k < X.cols(); ++k, ++idx) {
-            if (!strong_set[idx]) {
-                gradient[idx] = xs[idx] * (X.col(k).dot(residuals) - xm[idx] * resid_sum);
-                if (std::abs(gradient[idx]) > penalty[0] * penalty_type[idx] * cmult[idx]) {
-                    strong_set[idx] = true;
-                    ++num_violations;
-                }
+            if (!strong_set[idx] && !screened[idx] && std::abs(gradient[idx]) > penalty[0] * penalty_type[idx] * cmult[idx]) {
+                strong_set[idx] = true;
+                new_idx.push_back(idx);
             }
         }
         idx = idx + Fixed.cols();
         for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-            if (!strong_set[idx]) {
-                gradient[idx] = xs[idx] * (XZ.col(k).dot(residuals) - xm[idx] * resid_sum);
-                if (std::abs(gradient[idx]) > penalty[1] * penalty_type[idx] * cmult[idx]) {
-                    strong_set[idx] = true;
-                    ++num_violations;
-                }
+            if (!strong_set[idx] && !screened[idx] && std::abs(gradient[idx]) > penalty[1] * penalty_type[idx] * cmult[idx]) {
+                strong_set[idx] = true;
+                new_idx.push_back(idx);
             }
         }
-        return num_violations == 0;
+        const bool no_violations = new_idx.empty();
+        merge_strong(new_idx);
+        return no_violations;
     }
 };
 
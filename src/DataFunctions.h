@@ -1,7 +1,11 @@
 #ifndef DATA_FUNCTIONS_H
 #define DATA_FUNCTIONS_H
 
-#include <RcppEigen.h>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <cmath>
+#include <vector>
+#include "Kernels.h"
 
 template <typename matType>
 void compute_moments(const matType & X,
@@ -16,14 +20,14 @@ void compute_moments(const matType & X,
     if (centered) {
         if (scaled) {
             for (int j = 0; j < X.cols(); ++j, ++idx) {
-                auto xj = X.col(j);
+                auto xj = X.col(j).template cast<double>();
                 xm[idx] = xj.cwiseProduct(wgts_user).sum();
                 cent[idx] = xm[idx];
                 xs[idx] = 1 / std::sqrt(xj.cwiseProduct(xj.cwiseProduct(wgts_user)).sum() - xm[idx] * xm[idx]);
             }
         } else {
             for (int j = 0; j < X.cols(); ++j, ++idx) {
-                auto xj = X.col(j);
+                auto xj = X.col(j).template cast<double>();
                 xm[idx] = xj.cwiseProduct(wgts_user).sum();
                 cent[idx] = xm[idx];
                 xv[idx] = xj.cwiseProduct(xj.cwiseProduct(wgts_user)).sum() - xm[idx] * xm[idx];
@@ -33,7 +37,7 @@ void compute_moments(const matType & X,
     else {
         if (scaled) {
             for (int j = 0; j < X.cols(); ++j, ++idx) {
-                auto xj = X.col(j);
+                auto xj = X.col(j).template cast<double>();
                 xm[idx] = xj.cwiseProduct(wgts_user).sum();
                 double vc = xj.cwiseProduct(xj.cwiseProduct(wgts_user)).sum() - xm[idx] * xm[idx];
                 xs[idx] = 1 / std::sqrt(vc);
@@ -41,7 +45,7 @@ void compute_moments(const matType & X,
             }
         } else {
             for (int j = 0; j < X.cols(); ++j, ++idx) {
-                auto xj = X.col(j);
+                auto xj = X.col(j).template cast<double>();
                 xm[idx] = xj.cwiseProduct(wgts_user).sum();
                 xv[idx] = xj.cwiseProduct(xj.cwiseProduct(wgts_user)).sum();
             }
@@ -73,14 +77,15 @@ Eigen::MatrixXd create_XZ(const matA & X,
     auto cent_x = cent.head(X.cols());
     auto xs_x = xs.head(X.cols());
 
+    Eigen::VectorXd sj(X.cols());
     int col_xz = 0;
 
     // add intercept
     if (intr_ext) {
         auto xzj = XZ.col(col_xz);
-        xzj = (X * xs_x).array() - xs_x.cwiseProduct(cent_x).sum();
-        double xzj_mean = xzj.cwiseProduct(wgts_user).sum();
-        xv[idx] = xzj.cwiseProduct(xzj.cwiseProduct(wgts_user)).sum() - xzj_mean * xzj_mean;
+        xzj.setConstant(-xs_x.cwiseProduct(cent_x).sum());
+        multiply_add(X, xs_x, xzj);
+        xv[idx] = xzj.cwiseProduct(xzj.cwiseProduct(wgts_user)).sum();
         ++idx;
         ++col_xz;
     }
@@ -93,13 +98,153 @@ Eigen::MatrixXd create_XZ(const matA & X,
         if (scale_z) {
             xs[idx] = 1 / std::sqrt(zj.cwiseProduct(zj / zj.size()).sum() - xm[idx] * xm[idx]);
         }
-        xzj = xs[idx] * ((X * zj.cwiseProduct(xs_x)) - xs_x.cwiseProduct(cent_x.cwiseProduct(zj)).sum() * Eigen::VectorXd::Ones(X.rows()));
-        double xzj_mean = xzj.cwiseProduct(wgts_user).sum();
-        xv[idx] = xzj.cwiseProduct(xzj.cwiseProduct(wgts_user)).sum() - xzj_mean * xzj_mean;
+        sj = zj.cwiseProduct(xs_x);
+        xzj.setConstant(-cent_x.dot(sj));
+        multiply_add(X, sj, xzj);
+        xzj *= xs[idx];
+        xv[idx] = xzj.cwiseProduct(xzj.cwiseProduct(wgts_user)).sum();
         xzj /= xs[idx];
 
     }
     return XZ;
 }
 
+// moments of the columns of XZ without storing the n x q product, returns the
+// p x (intr_ext + q) weights S such that XZ.col(j) = X * S.col(j) - offset[j]
+template <typename matA, typename matB>
+Eigen::SparseMatrix<double> create_XZ_implicit(const matA & X,
+                                               const matB & Z,
+                                               Eigen::Ref<Eigen::VectorXd> xm,
+                                               const Eigen::Ref<const Eigen::VectorXd> & cent,
+                                               const Eigen::Ref<const Eigen::VectorXd> & wgts_user,
+                                               Eigen::Ref<Eigen::VectorXd> xv,
+                                               Eigen::Ref<Eigen::VectorXd> xs,
+                                               Eigen::VectorXd & offset,
+                                               const bool & intr_ext,
+                                               const bool & scale_z,
+                                               int idx) {
+
+    // initialize weights
+    Eigen::SparseMatrix<double> S(0, 0);
+    offset.resize(0);
+
+    if (Z.size() == 0)
+        return S;
+    else {
+        S.resize(X.cols(), intr_ext + Z.cols());
+        offset.resize(intr_ext + Z.cols());
+    }
+
+    // map means and sds of X
+    auto cent_x = cent.head(X.cols());
+    auto xs_x = xs.head(X.cols());
+
+    std::vector<Eigen::Triplet<double> > s_nz;
+    Eigen::VectorXd sj(X.cols());
+    Eigen::VectorXd xzj(X.rows());
+    int col_xz = 0;
+
+    // add intercept
+    if (intr_ext) {
+        sj = xs_x;
+        offset[col_xz] = cent_x.dot(sj);
+        xzj.setConstant(-offset[col_xz]);
+        multiply_add(X, sj, xzj);
+        xv[idx] = xzj.cwiseProduct(xzj.cwiseProduct(wgts_user)).sum();
+        for (int k = 0; k < sj.size(); ++k) {
+            if (sj[k] != 0.0) s_nz.push_back(Eigen::Triplet<double>(k, col_xz, sj[k]));
+        }
+        ++idx;
+        ++col_xz;
+    }
+
+    // weights / moments for columns of XZ
+    for (int j = 0; j < Z.cols(); ++j, ++col_xz, ++idx) {
+        auto zj = Z.col(j);
+        xm[idx] = zj.sum() / zj.size();
+        if (scale_z) {
+            xs[idx] = 1 / std::sqrt(zj.cwiseProduct(zj / zj.size()).sum() - xm[idx] * xm[idx]);
+        }
+        sj = zj.cwiseProduct(xs_x);
+        offset[col_xz] = cent_x.dot(sj);
+        xzj.setConstant(-offset[col_xz]);
+        multiply_add(X, sj, xzj);
+        xzj *= xs[idx];
+        xv[idx] = xzj.cwiseProduct(xzj.cwiseProduct(wgts_user)).sum();
+        for (int k = 0; k < sj.size(); ++k) {
+            if (sj[k] != 0.0) s_nz.push_back(Eigen::Triplet<double>(k, col_xz, sj[k]));
+        }
+    }
+    S.setFromTriplets(s_nz.begin(), s_nz.end());
+    S.makeCompressed();
+    return S;
+}
+
+// storage for a copy of a subset of the rows of X
+template <typename matType>
+struct RowSubset {
+    typedef Eigen::Matrix<typename matType::Scalar, Eigen::Dynamic, Eigen::Dynamic> type;
+};
+
+template <>
+struct RowSubset<Eigen::MappedSparseMatrix<double> > {
+    typedef Eigen::SparseMatrix<double> type;
+};
+
+// copy rows (in increasing order) of dense X into storage, returns a map of the copy
+template <typename Scalar>
+Eigen::Map<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> > subset_rows(
+        const Eigen::Map<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> > & X,
+        const std::vector<int> & rows,
+        Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> & storage) {
+    const int nr = rows.size();
+    storage.resize(nr, X.cols());
+    for (int j = 0; j < X.cols(); ++j) {
+        for (int i = 0; i < nr; ++i) {
+            storage(i, j) = X(rows[i], j);
+        }
+    }
+    return Eigen::Map<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> >(
+        storage.data(), storage.rows(), storage.cols()
+    );
+}
+
+// copy rows (in increasing order) of sparse X into storage, returns a map of the copy
+inline Eigen::MappedSparseMatrix<double> subset_rows(const Eigen::MappedSparseMatrix<double> & X,
+                                                     const std::vector<int> & rows,
+                                                     Eigen::SparseMatrix<double> & storage) {
+    std::vector<int> row_map(X.rows(), -1);
+    for (int i = 0; i < static_cast<int>(rows.size()); ++i) {
+        row_map[rows[i]] = i;
+    }
+    storage.resize(rows.size(), X.cols());
+    storage.reserve(X.nonZeros());
+    for (int j = 0; j < X.cols(); ++j) {
+        storage.startVec(j);
+        for (Eigen::MappedSparseMatrix<double>::InnerIterator it(X, j); it; ++it) {
+            if (row_map[it.index()] >= 0) {
+                storage.insertBack(row_map[it.index()], j) = it.value();
+            }
+        }
+    }
+    storage.finalize();
+    return Eigen::MappedSparseMatrix<double>(
+        storage.rows(), storage.cols(), storage.nonZeros(),
+        storage.outerIndexPtr(), storage.innerIndexPtr(), storage.valuePtr()
+    );
+}
+
+// copy rows (in increasing order) of dense matrix M
+inline Eigen::MatrixXd subset_rows(const Eigen::Ref<const Eigen::MatrixXd> & M,
+                                   const std::vector<int> & rows) {
+    const int nr = rows.size();
+    Eigen::MatrixXd out(nr, M.cols());
+    for (int j = 0; j < M.cols(); ++j) {
+        for (int i = 0; i < nr; ++i) {
+            out(i, j) = M(rows[i], j);
+        }
+    }
+    return out;
+}
+
 #endif // DATA_FUNCTIONS_H
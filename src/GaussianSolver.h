@@ -10,11 +10,13 @@ class GaussianSolver : public CoordSolver<T> {
     typedef Eigen::VectorXi VecXi;
     typedef Eigen::Map<const Eigen::MatrixXd> MapMat;
     typedef Eigen::MappedSparseMatrix<double> MapSpMat;
+    typedef Eigen::Matrix<typename T::Scalar, Eigen::Dynamic, Eigen::Dynamic> MatX;
     typedef Eigen::Map<const Eigen::VectorXd> MapVec;
 
 private:
     using CoordSolver<T>::wgts;
     using CoordSolver<T>::wgts_user;
+    using CoordSolver<T>::select_kernel;
     using CoordSolver<T>::y;
     using CoordSolver<T>::wgts_sum;
     using CoordSolver<T>::X;
@@ -27,13 +29,73 @@ private:
     using CoordSolver<T>::intercept;
     using CoordSolver<T>::ym;
     using CoordSolver<T>::ys;
+    using CoordSolver<T>::compute_gradient;
+    using CoordSolver<T>::n;
+    using CoordSolver<T>::nv_total;
+    using CoordSolver<T>::penalty;
+    using CoordSolver<T>::betas;
+    using CoordSolver<T>::b0;
+    using CoordSolver<T>::xv;
+    using CoordSolver<T>::xw;
+    using CoordSolver<T>::resids_sum;
+    using CoordSolver<T>::dlx;
+    using CoordSolver<T>::tolerance;
+    using CoordSolver<T>::num_passes;
+    using CoordSolver<T>::max_iterations;
+    using CoordSolver<T>::active_set;
+    using CoordSolver<T>::active_idx;
+    using CoordSolver<T>::update_estimate;
+    using CoordSolver<T>::standardized_col;
+    using CoordSolver<T>::standardized_dot;
+    using CoordSolver<T>::newton_passes;
+    using CoordSolver<T>::newton_features;
+    using CoordSolver<T>::newton_direction;
+    using CoordSolver<T>::newton_max_features;
+    using CoordSolver<T>::penalty_type;
+    using CoordSolver<T>::cmult;
+    using CoordSolver<T>::lcl;
+    using CoordSolver<T>::ucl;
+    using CoordSolver<T>::strong_set;
+    using CoordSolver<T>::screened;
+    using CoordSolver<T>::screened_idx;
+    using CoordSolver<T>::clear_screened;
+    using CoordSolver<T>::standardized_crossprod;
+    using CoordSolver<T>::use_anderson;
+    using CoordSolver<T>::anderson_count;
+    using CoordSolver<T>::anderson_extrapolate;
+    using CoordSolver<T>::anderson_penalty;
+
+    // weighted inner products of standardized active columns (covariance
+    // updates), used while the active set is small relative to n
+    Eigen::MatrixXd gram;
+    std::vector<int> gram_pos;
+    std::vector<int> gram_idx;
+    VecXd col_buf;
+    const int gram_max_features = 1000;
+    const int gram_min_ratio = 4;
+
+    // unpenalized directions (intercept, features with cmult == 0) that dual
+    // points are projected against for the duality gap: weighted columns
+    // W * A, their products with all standardized columns and A^T * W * A
+    std::vector<int> unpen_idx;
+    Eigen::MatrixXd unpen_cols;
+    Eigen::MatrixXd unpen_cross;
+    Eigen::LDLT<Eigen::MatrixXd> unpen_gram;
+    bool gap_available;
+    const int gap_max_unpen = 50;
+    double null_objective;
+    const bool dual_gap;
+    const double tolerance_gap;
+
+    // penalties of the current screened set
+    VecXd penalty_screen;
 
 public:
     // constructor (dense X matrix)
     GaussianSolver(const Eigen::Ref<const Eigen::MatrixXd> & y_,
-                   const Eigen::Ref<const Eigen::MatrixXd> & X_,
+                   const Eigen::Ref<const MatX> & X_,
                    const Eigen::Ref<const Eigen::MatrixXd> & Fixed_,
-                   const Eigen::Ref<const Eigen::MatrixXd> & XZ_,
+                   const XZMatrix<T> & XZ_,
                    const double * xmptr,
                    double * xvptr,
                    const double * xsptr,
@@ -47,7 +109,8 @@ public:
                    int ne_,
                    int nx_,
                    double tolerance_,
-                   int max_iterations_) :
+                   int max_iterations_,
+                   bool dual_gap_) :
     CoordSolver<T>(y_,
                    X_,
                    Fixed_,
@@ -65,7 +128,10 @@ public:
                    ne_,
                    nx_,
                    tolerance_,
-                   max_iterations_)
+                   max_iterations_),
+                   dual_gap(dual_gap_),
+                   tolerance_gap(tolerance_),
+                   penalty_screen(VecXd::Constant(2, -1.0))
                    {
                        init();
                    };
@@ -74,7 +140,7 @@ public:
     GaussianSolver(const Eigen::Ref<const Eigen::MatrixXd> & y_,
                    const MapSpMat X_,
                    const Eigen::Ref<const Eigen::MatrixXd> & Fixed_,
-                   const Eigen::Ref<const Eigen::MatrixXd> & XZ_,
+                   const XZMatrix<T> & XZ_,
                    const double * xmptr,
                    double * xvptr,
                    const double * xsptr,
@@ -88,7 +154,8 @@ public:
                    int ne_,
                    int nx_,
                    double tolerance_,
-                   int max_iterations_) :
+                   int max_iterations_,
+                   bool dual_gap_) :
         CoordSolver<T>(y_,
                        X_,
                        Fixed_,
@@ -106,7 +173,10 @@ public:
                        ne_,
                        nx_,
                        tolerance_,
-                       max_iterations_)
+                       max_iterations_),
+                       dual_gap(dual_gap_),
+                       tolerance_gap(tolerance_),
+                       penalty_screen(VecXd::Constant(2, -1.0))
                        {
                            init();
                        };
@@ -114,6 +184,13 @@ public:
     // destructor
     virtual ~GaussianSolver() {}
 
+    // copy of the solver with weighted sum squares in xvptr
+    virtual CoordSolver<T> * clone(double * xvptr) const {
+        GaussianSolver<T> * s = new GaussianSolver<T>(*this);
+        s->rebind_xv(xvptr);
+        return s;
+    }
+
     // initialize function
     void init() {
         wgts = wgts_user;
@@ -122,15 +199,349 @@ public:
         ys = std::sqrt(y.col(0).cwiseProduct(y.col(0).cwiseProduct(wgts_user)).sum() - ym * ym);
         if (!intercept) {ym = 0.0;}
         residuals.array() = wgts.array() * (y.col(0).array() - ym) / ys;
-        double resids_sum = residuals.sum();
+        compute_gradient();
+        gram_pos.assign(nv_total, -1);
+        col_buf.resize(n);
+        init_dual();
+        select_kernel(true);
+    }
+
+    // projection onto the unpenalized directions used for dual points, the
+    // gap is not available if any limits exclude zero or there are too many
+    // unpenalized features
+    void init_dual() {
+        null_objective = 0.5 * (residuals.array().square() / wgts.array().max(1e-300)).sum();
+        gap_available = true;
+        for (int idx = 0; idx < nv_total; ++idx) {
+            if (lcl[idx] > 0.0 || ucl[idx] < 0.0) gap_available = false;
+            if (cmult[idx] == 0.0) unpen_idx.push_back(idx);
+        }
+        const int na = intercept + unpen_idx.size();
+        if (na > gap_max_unpen) gap_available = false;
+        if (!gap_available || na == 0) return;
+        unpen_cols.resize(n, na);
+        unpen_cross.resize(nv_total, na);
+        Eigen::MatrixXd M(na, na);
+        if (intercept) {
+            unpen_cols.col(0) = wgts;
+        }
+        for (std::size_t k = 0; k < unpen_idx.size(); ++k) {
+            standardized_col(unpen_idx[k], col_buf);
+            unpen_cols.col(intercept + k) = col_buf.cwiseProduct(wgts);
+        }
+        for (int a = 0; a < na; ++a) {
+            standardized_crossprod(unpen_cols.col(a), unpen_cols.col(a).sum(), unpen_cross.col(a));
+            if (intercept) M(0, a) = unpen_cols.col(a).sum();
+            for (std::size_t k = 0; k < unpen_idx.size(); ++k) {
+                M(intercept + k, a) = unpen_cross(unpen_idx[k], a);
+            }
+        }
+        unpen_gram.compute(M);
+    }
+
+    // conjugate of the penalty of feature idx (l1 weight a, l2 weight b2)
+    // within its limits, infinite if v is outside its domain
+    double penalty_conjugate(const int & idx, const double & v,
+                             const double & a, const double & b2) const {
+        const double t = std::abs(v) - a;
+        if (t <= 0.0) return 0.0;
+        if (b2 > 0.0) {
+            const double bk = std::max(lcl[idx], std::min(ucl[idx], copysign(t, v) / b2));
+            return v * bk - a * std::abs(bk) - 0.5 * b2 * bk * bk;
+        }
+        return t * std::abs(v > 0.0 ? ucl[idx] : lcl[idx]);
+    }
 
-        int idx = 0;
-        for (int k = 0; k < X.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (X.col(k).dot(residuals) - xm[idx] * resids_sum);
+    // duality gap of the current estimates, the dual point is the residual
+    // vector projected against the unpenalized directions and scaled to be
+    // feasible, gradient must be up to date with the residuals for features
+    // that are not screened, features outside the strong set whose zero
+    // estimate is certified by the gap safe sphere (radius sqrt(2 * gap) in
+    // the W^-1 norm) are added to the screened set, screened features are
+    // left out of the gap as they are zero at the solution
+    double screen_gap() {
+        if (!gap_available) return INFINITY;
+        const int offset_xz = X.cols() + Fixed.cols();
+        VecXd lam(nv_total);
+        for (int idx = 0; idx < nv_total; ++idx) {
+            lam[idx] = cmult[idx] * (idx < offset_xz ? penalty[0] : penalty[1]);
+            if (cmult[idx] > 0.0 && lam[idx] == 0.0) return INFINITY;
+        }
+
+        // project residuals against unpenalized directions
+        const int na = unpen_cols.cols();
+        VecXd theta = residuals;
+        VecXd c;
+        if (na > 0) {
+            VecXd atr(na);
+            if (intercept) atr[0] = resids_sum;
+            for (std::size_t k = 0; k < unpen_idx.size(); ++k) {
+                atr[intercept + k] = gradient[unpen_idx[k]];
+            }
+            c = unpen_gram.solve(atr);
+            theta.noalias() -= unpen_cols * c;
+        }
+        VecXd v(nv_total);
+        for (int idx = 0; idx < nv_total; ++idx) {
+            if (screened[idx]) continue;
+            v[idx] = na > 0 ? gradient[idx] - unpen_cross.row(idx).dot(c) : gradient[idx];
+        }
+
+        // scale dual point into the domain of the penalty conjugates
+        double scale = 1.0;
+        for (int idx = 0; idx < nv_total; ++idx) {
+            if (lam[idx] == 0.0 || screened[idx]) continue;
+            const double a = lam[idx] * penalty_type[idx];
+            const double b2 = lam[idx] * (1 - penalty_type[idx]);
+            const double bound = v[idx] > 0.0 ? ucl[idx] : lcl[idx];
+            if (b2 == 0.0 && std::abs(v[idx]) > a && std::isinf(bound)) {
+                scale = std::min(scale, a / std::abs(v[idx]));
+            }
+        }
+
+        // primal and dual objectives
+        double primal = 0.0;
+        double dual = 0.0;
+        for (int i = 0; i < n; ++i) {
+            if (wgts[i] > 0.0) {
+                primal += 0.5 * residuals[i] * residuals[i] / wgts[i];
+                dual += scale * theta[i] * (y(i, 0) - ym) / ys -
+                    0.5 * scale * scale * theta[i] * theta[i] / wgts[i];
+            }
+        }
+        for (int idx = 0; idx < nv_total; ++idx) {
+            if (lam[idx] == 0.0 || screened[idx]) continue;
+            const double a = lam[idx] * penalty_type[idx];
+            const double b2 = lam[idx] * (1 - penalty_type[idx]);
+            primal += a * std::abs(betas[idx]) + 0.5 * b2 * betas[idx] * betas[idx];
+            dual -= penalty_conjugate(idx, scale * v[idx], a, b2);
+        }
+        const double gap = std::max(0.0, primal - dual);
+
+        // gap safe sphere test
+        const double radius = std::sqrt(2.0 * gap);
+        for (int idx = 0; idx < nv_total; ++idx) {
+            if (lam[idx] > 0.0 && !strong_set[idx] && !screened[idx] &&
+                scale * std::abs(v[idx]) + radius * std::sqrt(xv[idx]) < lam[idx] * penalty_type[idx]) {
+                screened[idx] = true;
+                screened_idx.push_back(idx);
+            }
+        }
+        return gap;
+    }
+
+    // screening at the start of each penalty, the screened set is kept
+    // while the penalty is unchanged, inner tolerance is reset
+    virtual void safe_screen() {
+        tolerance = tolerance_gap;
+        if (penalty != penalty_screen) {
+            clear_screened();
+            penalty_screen = penalty;
+        }
+        screen_gap();
+    }
+
+    // kkt check (screened features cannot violate the conditions), with
+    // dual_gap the relative duality gap must also be below the tolerance,
+    // otherwise coordinate descent continues with a tighter tolerance
+    virtual bool check_kkt() {
+        const bool no_violations = CoordSolver<T>::check_kkt();
+        const double gap = screen_gap();
+        if (!no_violations || !dual_gap || !gap_available) return no_violations;
+        if (gap <= tolerance_gap * null_objective || tolerance < 1e-6 * tolerance_gap) return true;
+        tolerance *= 0.1;
+        return false;
+    }
+
+    // passes over the active set, when n is large relative to the number of
+    // active features the gradient of each active feature is updated from
+    // the gram matrix in O(|active|) per coordinate instead of updating the
+    // residuals in O(n), and the residuals are brought up to date at the end
+    virtual void solve_active() {
+        const int num_active = active_idx.size();
+        if (num_active == 0 || num_active > gram_max_features ||
+            n < gram_min_ratio * num_active) {
+            CoordSolver<T>::solve_active();
+            return;
+        }
+        update_gram();
+
+        // gradients and weighted sums of active features (gram order)
+        const int m = gram_idx.size();
+        VecXd grad(m);
+        VecXd xw_gram(m);
+        VecXd del_total = VecXd::Zero(m);
+        for (int j = 0; j < m; ++j) {
+            grad[j] = standardized_dot(gram_idx[j], residuals, resids_sum);
+            xw_gram[j] = xw[gram_idx[j]];
+        }
+
+        double del0_total = 0.0;
+        const int offset_xz = X.cols() + Fixed.cols();
+        int passes = 0;
+        anderson_count = 0;
+        while (num_passes < max_iterations) {
+            dlx = 0.0;
+            for (int a = 0; a < num_active; ++a) {
+                const int idx = active_idx[a];
+                const int j = gram_pos[idx];
+                const double lam = idx < offset_xz ? penalty[0] : penalty[1];
+                const double bk = betas[idx];
+                betas[idx] = update_estimate(idx, grad[j], lam);
+                if (betas[idx] != bk) {
+                    const double del = betas[idx] - bk;
+                    grad.noalias() -= del * gram.col(j);
+                    resids_sum -= del * xw[idx];
+                    del_total[j] += del;
+                    dlx = std::max(dlx, xv[idx] * del * del);
+                }
+            }
+            if (intercept) {
+                const double del = resids_sum / wgts_sum;
+                b0 += del;
+                grad.noalias() -= del * xw_gram;
+                resids_sum -= del * wgts_sum;
+                del0_total += del;
+                dlx = std::max(dlx, del * del * wgts_sum);
+            }
+            ++num_passes;
+            if (dlx < tolerance) break;
+            if (use_anderson) {
+                anderson_step_gram(grad, xw_gram, del_total, del0_total);
+            }
+            if (++passes == newton_passes() &&
+                newton_step_gram(grad, xw_gram, del_total, del0_total)) {
+                anderson_count = 0;
+            }
+        }
+
+        // apply accumulated changes to residuals
+        for (int j = 0; j < m; ++j) {
+            if (del_total[j] != 0.0) {
+                standardized_col(gram_idx[j], col_buf);
+                axpy_centered_weighted(-del_total[j], col_buf, 0.0, wgts, residuals);
+            }
+        }
+        if (del0_total != 0.0) {
+            residuals.noalias() -= del0_total * wgts;
+        }
+    }
+
+    // newton step on the free active features (see CoordSolver::newton_step)
+    // with the hessian taken from the gram matrix and gradients of the
+    // covariance updates, changes are accumulated like coordinate updates
+    bool newton_step_gram(VecXd & grad,
+                          const VecXd & xw_gram,
+                          VecXd & del_total,
+                          double & del0_total) {
+        std::vector<int> free_idx;
+        newton_features(free_idx);
+        const int m = free_idx.size();
+        if (m == 0 || m > newton_max_features) return false;
+
+        const int dim = m + intercept;
+        Eigen::MatrixXd H(dim, dim);
+        VecXd g(dim);
+        for (int k = 0; k < m; ++k) {
+            const int pk = gram_pos[free_idx[k]];
+            for (int j = 0; j < m; ++j) {
+                H(j, k) = gram(gram_pos[free_idx[j]], pk);
+            }
+            g[k] = grad[pk];
+            if (intercept) {
+                H(m, k) = xw_gram[pk];
+                H(k, m) = H(m, k);
+            }
+        }
+        if (intercept) {
+            H(m, m) = wgts_sum;
+            g[m] = resids_sum;
+        }
+
+        VecXd d;
+        if (!newton_direction(free_idx, H, g, d)) return false;
+        for (int k = 0; k < m; ++k) {
+            const int idx = free_idx[k];
+            const int pk = gram_pos[idx];
+            betas[idx] += d[k];
+            grad.noalias() -= d[k] * gram.col(pk);
+            resids_sum -= d[k] * xw[idx];
+            del_total[pk] += d[k];
+            dlx = std::max(dlx, xv[idx] * d[k] * d[k]);
+        }
+        if (intercept) {
+            b0 += d[m];
+            grad.noalias() -= d[m] * xw_gram;
+            resids_sum -= d[m] * wgts_sum;
+            del0_total += d[m];
+            dlx = std::max(dlx, d[m] * d[m] * wgts_sum);
+        }
+        return true;
+    }
+
+    // anderson extrapolation of the active features (see
+    // CoordSolver::anderson_step), the change in the objective is computed
+    // from the gram matrix and gradients of the covariance updates
+    bool anderson_step_gram(VecXd & grad,
+                            const VecXd & xw_gram,
+                            VecXd & del_total,
+                            double & del0_total) {
+        VecXd d;
+        if (!anderson_extrapolate(d)) return false;
+        const int m = active_idx.size();
+        VecXd dg = VecXd::Zero(gram_idx.size());
+        for (int a = 0; a < m; ++a) {
+            dg[gram_pos[active_idx[a]]] = d[a];
+        }
+        const double d0 = d[m];
+        const double dloss = 0.5 * dg.dot(gram * dg) + d0 * dg.dot(xw_gram) +
+            0.5 * d0 * d0 * wgts_sum - dg.dot(grad) - d0 * resids_sum;
+        if (dloss + anderson_penalty(d) >= 0.0) return false;
+
+        for (int a = 0; a < m; ++a) {
+            betas[active_idx[a]] += d[a];
+            resids_sum -= d[a] * xw[active_idx[a]];
+        }
+        grad.noalias() -= gram * dg;
+        del_total += dg;
+        b0 += d0;
+        grad.noalias() -= d0 * xw_gram;
+        resids_sum -= d0 * wgts_sum;
+        del0_total += d0;
+        return true;
+    }
+
+    // extend gram matrix with features that entered the active set, it is
+    // rebuilt if a feature left the active set (XZ features at m2 == 0)
+    void update_gram() {
+        for (std::size_t j = 0; j < gram_idx.size(); ++j) {
+            if (!active_set[gram_idx[j]]) {
+                for (std::size_t i = 0; i < gram_idx.size(); ++i) {
+                    gram_pos[gram_idx[i]] = -1;
+                }
+                gram_idx.clear();
+                gram.resize(0, 0);
+                break;
+            }
+        }
+        const int m_old = gram_idx.size();
+        for (std::size_t a = 0; a < active_idx.size(); ++a) {
+            if (gram_pos[active_idx[a]] < 0) {
+                gram_pos[active_idx[a]] = gram_idx.size();
+                gram_idx.push_back(active_idx[a]);
+            }
         }
-        idx += Fixed.cols();
-        for (int k = 0; k < XZ.cols(); ++k, ++idx) {
-            gradient[idx] = xs[idx] * (XZ.col(k).dot(residuals) - xm[idx] * resids_sum);
+        const int m = gram_idx.size();
+        if (m == m_old) return;
+        gram.conservativeResize(m, m);
+        for (int k = m_old; k < m; ++k) {
+            standardized_col(gram_idx[k], col_buf);
+            col_buf.array() *= wgts.array();
+            const double col_sum = col_buf.sum();
+            for (int j = 0; j <= k; ++j) {
+                gram(j, k) = standardized_dot(gram_idx[j], col_buf, col_sum);
+                gram(k, j) = gram(j, k);
+            }
         }
     }
 };
@@ -0,0 +1,98 @@
+#include "Kernels.h"
+
+// build each dense kernel for several instruction sets and pick one at load
+// time from the CPU features (GCC / clang ifunc dispatch, x86-64 Linux only),
+// elsewhere the kernels are compiled once for the baseline target
+#if defined(__x86_64__) && defined(__linux__) && \
+    ((defined(__clang__) && __clang_major__ >= 14) || \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 6))
+#define XRNET_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define XRNET_TARGET_CLONES
+#endif
+
+XRNET_TARGET_CLONES
+double dot_dense(const double * x, const double * y, const int n) {
+    double val = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:val)
+#endif
+    for (int i = 0; i < n; ++i) {
+        val += x[i] * y[i];
+    }
+    return val;
+}
+
+XRNET_TARGET_CLONES
+void axpy_centered_weighted_dense(const double a,
+                                  const double * x,
+                                  const double c,
+                                  const double * w,
+                                  double * out,
+                                  const int n) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < n; ++i) {
+        out[i] += a * (x[i] - c) * w[i];
+    }
+}
+
+XRNET_TARGET_CLONES
+double weighted_sum_squares_dense(const double * x,
+                                  const double c,
+                                  const double * w,
+                                  const int n) {
+    double val = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:val)
+#endif
+    for (int i = 0; i < n; ++i) {
+        const double xc = x[i] - c;
+        val += w[i] * xc * xc;
+    }
+    return val;
+}
+
+XRNET_TARGET_CLONES
+double dot_dense(const float * x, const double * y, const int n) {
+    double val = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:val)
+#endif
+    for (int i = 0; i < n; ++i) {
+        val += static_cast<double>(x[i]) * y[i];
+    }
+    return val;
+}
+
+XRNET_TARGET_CLONES
+void axpy_centered_weighted_dense(const double a,
+                                  const float * x,
+                                  const double c,
+                                  const double * w,
+                                  double * out,
+                                  const int n) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < n; ++i) {
+        out[i] += a * (static_cast<double>(x[i]) - c) * w[i];
+    }
+}
+
+XRNET_TARGET_CLONES
+double weighted_sum_squares_dense(const float * x,
+                                  const double c,
+                                  const double * w,
+                                  const int n) {
+    double val = 0.0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+:val)
+#endif
+    for (int i = 0; i < n; ++i) {
+        const double xc = static_cast<double>(x[i]) - c;
+        val += w[i] * xc * xc;
+    }
+    return val;
+}
@@ -0,0 +1,253 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <algorithm>
+
+// fused loops over contiguous dense columns, vectorized and dispatched on
+// the instruction set of the CPU at run time (see Kernels.cpp)
+double dot_dense(const double * x, const double * y, const int n);
+void axpy_centered_weighted_dense(const double a,
+                                  const double * x,
+                                  const double c,
+                                  const double * w,
+                                  double * out,
+                                  const int n);
+double weighted_sum_squares_dense(const double * x,
+                                  const double c,
+                                  const double * w,
+                                  const int n);
+
+// single precision columns, accumulated in double precision
+double dot_dense(const float * x, const double * y, const int n);
+void axpy_centered_weighted_dense(const double a,
+                                  const float * x,
+                                  const double c,
+                                  const double * w,
+                                  double * out,
+                                  const int n);
+double weighted_sum_squares_dense(const float * x,
+                                  const double c,
+                                  const double * w,
+                                  const int n);
+
+// out = X^T * r for dense X, columns are split into contiguous blocks so each
+// thread runs a cache-blocked GEMV on its own slab of X
+inline void crossprod(const Eigen::Map<const Eigen::MatrixXd> & X,
+                      const Eigen::Ref<const Eigen::VectorXd> & r,
+                      Eigen::Ref<Eigen::VectorXd> out,
+                      const int & num_threads) {
+    const int p = X.cols();
+    if (num_threads <= 1 || p < 2 * num_threads) {
+        out.noalias() = X.transpose() * r;
+        return;
+    }
+    const int block_size = std::max(64, (p + 4 * num_threads - 1) / (4 * num_threads));
+    const int num_blocks = (p + block_size - 1) / block_size;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+#endif
+    for (int b = 0; b < num_blocks; ++b) {
+        const int start = b * block_size;
+        const int len = std::min(block_size, p - start);
+        out.segment(start, len).noalias() = X.middleCols(start, len).transpose() * r;
+    }
+}
+
+// out = X^T * r for single precision dense X, one double precision dot
+// product per column
+inline void crossprod(const Eigen::Map<const Eigen::MatrixXf> & X,
+                      const Eigen::Ref<const Eigen::VectorXd> & r,
+                      Eigen::Ref<Eigen::VectorXd> out,
+                      const int & num_threads) {
+    const int p = X.cols();
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) num_threads(num_threads) if(num_threads > 1)
+#endif
+    for (int j = 0; j < p; ++j) {
+        out[j] = dot_dense(X.col(j).data(), r.data(), X.rows());
+    }
+}
+
+// out += X * B for dense or sparse X
+template <typename TX>
+inline void multiply_add(const TX & X,
+                         const Eigen::Ref<const Eigen::MatrixXd> & B,
+                         Eigen::Ref<Eigen::MatrixXd> out) {
+    out.noalias() += X * B;
+}
+
+// out += X * B for single precision dense X, converted to double precision
+// in blocks of columns
+inline void multiply_add(const Eigen::Map<const Eigen::MatrixXf> & X,
+                         const Eigen::Ref<const Eigen::MatrixXd> & B,
+                         Eigen::Ref<Eigen::MatrixXd> out) {
+    const int block_size = 256;
+    for (int start = 0; start < X.cols(); start += block_size) {
+        const int len = std::min(block_size, static_cast<int>(X.cols()) - start);
+        out.noalias() += X.middleCols(start, len).cast<double>() * B.middleRows(start, len);
+    }
+}
+
+// out = X^T * r for sparse (column compressed) X
+inline void crossprod(const Eigen::MappedSparseMatrix<double> & X,
+                      const Eigen::Ref<const Eigen::VectorXd> & r,
+                      Eigen::Ref<Eigen::VectorXd> out,
+                      const int & num_threads) {
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 256) num_threads(num_threads) if(num_threads > 1)
+#endif
+    for (int j = 0; j < X.outerSize(); ++j) {
+        double val = 0.0;
+        for (Eigen::MappedSparseMatrix<double>::InnerIterator it(X, j); it; ++it) {
+            val += it.value() * r[it.index()];
+        }
+        out[j] = val;
+    }
+}
+
+// x^T * r for a dense column x
+inline double dot_column(const Eigen::Ref<const Eigen::VectorXd> & x,
+                         const Eigen::Ref<const Eigen::VectorXd> & r) {
+    return dot_dense(x.data(), r.data(), x.size());
+}
+
+// x^T * r for a dense single precision column x
+inline double dot_column(const Eigen::Ref<const Eigen::VectorXf> & x,
+                         const Eigen::Ref<const Eigen::VectorXd> & r) {
+    return dot_dense(x.data(), r.data(), x.size());
+}
+
+// x^T * r for a sparse column x
+template <typename Derived>
+inline double dot_column(const Eigen::SparseMatrixBase<Derived> & x,
+                         const Eigen::Ref<const Eigen::VectorXd> & r) {
+    return x.derived().dot(r);
+}
+
+// out += a * (x - c) for a dense (double or single precision) column x
+template <typename Derived>
+inline void axpy_centered(const double & a,
+                          const Eigen::MatrixBase<Derived> & x,
+                          const double & c,
+                          Eigen::Ref<Eigen::VectorXd> out) {
+    out.array() += a * (x.derived().template cast<double>().array() - c);
+}
+
+// out += a * (x - c) for a sparse column x, only nonzeros of x are visited
+// and centering is applied as a constant shift
+template <typename Derived>
+inline void axpy_centered(const double & a,
+                          const Eigen::SparseMatrixBase<Derived> & x,
+                          const double & c,
+                          Eigen::Ref<Eigen::VectorXd> out) {
+    Eigen::internal::evaluator<Derived> xeval(x.derived());
+    for (typename Eigen::internal::evaluator<Derived>::InnerIterator it(xeval, 0); it; ++it) {
+        out[it.index()] += a * it.value();
+    }
+    if (c != 0.0) {
+        out.array() -= a * c;
+    }
+}
+
+// out += X * B for sparse (column compressed) B, only the columns of X with
+// nonzero coefficients are visited
+template <typename TX>
+inline void multiply_add(const TX & X,
+                         const Eigen::MappedSparseMatrix<double> & B,
+                         Eigen::Ref<Eigen::MatrixXd> out) {
+    for (int j = 0; j < B.outerSize(); ++j) {
+        for (Eigen::MappedSparseMatrix<double>::InnerIterator it(B, j); it; ++it) {
+            axpy_centered(it.value(), X.col(it.index()), 0.0, out.col(j));
+        }
+    }
+}
+
+// out += a * (x - c) * w for a dense column x
+inline void axpy_centered_weighted(const double & a,
+                                   const Eigen::Ref<const Eigen::VectorXd> & x,
+                                   const double & c,
+                                   const Eigen::Ref<const Eigen::VectorXd> & w,
+                                   Eigen::Ref<Eigen::VectorXd> out) {
+    axpy_centered_weighted_dense(a, x.data(), c, w.data(), out.data(), x.size());
+}
+
+// out += a * (x - c) * w for a dense single precision column x
+inline void axpy_centered_weighted(const double & a,
+                                   const Eigen::Ref<const Eigen::VectorXf> & x,
+                                   const double & c,
+                                   const Eigen::Ref<const Eigen::VectorXd> & w,
+                                   Eigen::Ref<Eigen::VectorXd> out) {
+    axpy_centered_weighted_dense(a, x.data(), c, w.data(), out.data(), x.size());
+}
+
+// out += a * (x - c) * w for a sparse column x
+template <typename Derived>
+inline void axpy_centered_weighted(const double & a,
+                                   const Eigen::SparseMatrixBase<Derived> & x,
+                                   const double & c,
+                                   const Eigen::Ref<const Eigen::VectorXd> & w,
+                                   Eigen::Ref<Eigen::VectorXd> out) {
+    Eigen::internal::evaluator<Derived> xeval(x.derived());
+    for (typename Eigen::internal::evaluator<Derived>::InnerIterator it(xeval, 0); it; ++it) {
+        out[it.index()] += a * it.value() * w[it.index()];
+    }
+    if (c != 0.0) {
+        out -= (a * c) * w;
+    }
+}
+
+// sum(w * (x - c)^2) for a dense column x
+inline double weighted_sum_squares(const Eigen::Ref<const Eigen::VectorXd> & x,
+                                   const double & c,
+                                   const Eigen::Ref<const Eigen::VectorXd> & w,
+                                   const double & /* w_sum */) {
+    return weighted_sum_squares_dense(x.data(), c, w.data(), x.size());
+}
+
+// sum(w * (x - c)^2) for a dense single precision column x
+inline double weighted_sum_squares(const Eigen::Ref<const Eigen::VectorXf> & x,
+                                   const double & c,
+                                   const Eigen::Ref<const Eigen::VectorXd> & w,
+                                   const double & /* w_sum */) {
+    return weighted_sum_squares_dense(x.data(), c, w.data(), x.size());
+}
+
+// sum(w * (x - c)^2) for a sparse column x, expanded as
+// sum(w * x^2) - 2 * c * sum(w * x) + c^2 * sum(w) over the nonzeros of x
+template <typename Derived>
+inline double weighted_sum_squares(const Eigen::SparseMatrixBase<Derived> & x,
+                                   const double & c,
+                                   const Eigen::Ref<const Eigen::VectorXd> & w,
+                                   const double & w_sum) {
+    double wxx = 0.0;
+    double wx = 0.0;
+    Eigen::internal::evaluator<Derived> xeval(x.derived());
+    for (typename Eigen::internal::evaluator<Derived>::InnerIterator it(xeval, 0); it; ++it) {
+        const double wxi = w[it.index()] * it.value();
+        wx += wxi;
+        wxx += wxi * it.value();
+    }
+    return wxx - 2 * c * wx + c * c * w_sum;
+}
+
+// prob = 1 / (1 + exp(-eta)), the exponential is evaluated in vectorized
+// packets by Eigen and eta beyond +-thresh gives prob of exactly 0 / 1
+// (prob must not alias eta, eta is read again after prob is written)
+inline void logistic(const Eigen::Ref<const Eigen::VectorXd> & eta,
+                     const double & thresh,
+                     Eigen::Ref<Eigen::VectorXd> prob) {
+    prob.array() = 1.0 / (1.0 + (-eta.array()).exp());
+    prob.array() = (eta.array().abs() >= thresh).select((eta.array() > 0.0).cast<double>(), prob.array());
+}
+
+// sum(y * eta - log(1 + exp(eta))), evaluated as
+// y * eta - max(eta, 0) - log(1 + exp(-|eta|)) so exp never overflows
+inline double binomial_loglik(const Eigen::Ref<const Eigen::VectorXd> & y,
+                              const Eigen::Ref<const Eigen::VectorXd> & eta) {
+    return (y.array() * eta.array() - eta.array().max(0.0) -
+            (1.0 + (-eta.array().abs()).exp()).log()).sum();
+}
+
+#endif // KERNELS_H
@@ -6,27 +6,9 @@
 
 using namespace Rcpp;
 
-// computeResponseRcpp
-Eigen::MatrixXd computeResponseRcpp(SEXP X, const int& mattype_x, const Eigen::Map<Eigen::MatrixXd> Fixed, const Eigen::Map<Eigen::VectorXd> beta0, const Eigen::Map<Eigen::MatrixXd> betas, const Eigen::Map<Eigen::MatrixXd> gammas, const std::string& response_type, const std::string& family);
-RcppExport SEXP _xrnet_computeResponseRcpp(SEXP XSEXP, SEXP mattype_xSEXP, SEXP FixedSEXP, SEXP beta0SEXP, SEXP betasSEXP, SEXP gammasSEXP, SEXP response_typeSEXP, SEXP familySEXP) {
-BEGIN_RCPP
-    Rcpp::RObject rcpp_result_gen;
-    Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
-    Rcpp::traits::input_parameter< const int& >::type mattype_x(mattype_xSEXP);
-    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::MatrixXd> >::type Fixed(FixedSEXP);
-    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXd> >::type beta0(beta0SEXP);
-    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::MatrixXd> >::type betas(betasSEXP);
-    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::MatrixXd> >::type gammas(gammasSEXP);
-    Rcpp::traits::input_parameter< const std::string& >::type response_type(response_typeSEXP);
-    Rcpp::traits::input_parameter< const std::string& >::type family(familySEXP);
-    rcpp_result_gen = Rcpp::wrap(computeResponseRcpp(X, mattype_x, Fixed, beta0, betas, gammas, response_type, family));
-    return rcpp_result_gen;
-END_RCPP
-}
 // fitModelCVRcpp
-Eigen::VectorXd fitModelCVRcpp(SEXP x, const int mattype_x, const Eigen::Map<Eigen::MatrixXd> y, SEXP ext, const bool& is_sparse_ext, const Eigen::Map<Eigen::MatrixXd> fixed, Eigen::VectorXd weights_user, const Rcpp::LogicalVector& intr, const Rcpp::LogicalVector& stnd, const Eigen::Map<Eigen::VectorXd> penalty_type, const Eigen::Map<Eigen::VectorXd> cmult, const Eigen::Map<Eigen::VectorXd> quantiles, const Rcpp::IntegerVector& num_penalty, const Rcpp::NumericVector& penalty_ratio, const Eigen::Map<Eigen::VectorXd> penalty_user, const Eigen::Map<Eigen::VectorXd> penalty_user_ext, Eigen::VectorXd lower_cl, Eigen::VectorXd upper_cl, const std::string& family, const std::string& user_loss, const Eigen::Map<Eigen::VectorXi> test_idx, const double& thresh, const int& maxit, const int& ne, const int& nx);
-RcppExport SEXP _xrnet_fitModelCVRcpp(SEXP xSEXP, SEXP mattype_xSEXP, SEXP ySEXP, SEXP extSEXP, SEXP is_sparse_extSEXP, SEXP fixedSEXP, SEXP weights_userSEXP, SEXP intrSEXP, SEXP stndSEXP, SEXP penalty_typeSEXP, SEXP cmultSEXP, SEXP quantilesSEXP, SEXP num_penaltySEXP, SEXP penalty_ratioSEXP, SEXP penalty_userSEXP, SEXP penalty_user_extSEXP, SEXP lower_clSEXP, SEXP upper_clSEXP, SEXP familySEXP, SEXP user_lossSEXP, SEXP test_idxSEXP, SEXP threshSEXP, SEXP maxitSEXP, SEXP neSEXP, SEXP nxSEXP) {
+Eigen::MatrixXd fitModelCVRcpp(SEXP x, const int mattype_x, const Eigen::Map<Eigen::MatrixXd> y, SEXP ext, const bool& is_sparse_ext, const Eigen::Map<Eigen::MatrixXd> fixed, const Eigen::Map<Eigen::VectorXd> weights_user, const Rcpp::LogicalVector& intr, const Rcpp::LogicalVector& stnd, const Eigen::Map<Eigen::VectorXd> penalty_type, const Eigen::Map<Eigen::VectorXd> cmult, const Eigen::Map<Eigen::VectorXd> quantiles, const Rcpp::IntegerVector& num_penalty, const Rcpp::NumericVector& penalty_ratio, const Eigen::Map<Eigen::VectorXd> penalty_user, const Eigen::Map<Eigen::VectorXd> penalty_user_ext, const Eigen::Map<Eigen::VectorXd> lower_cl, const Eigen::Map<Eigen::VectorXd> upper_cl, const std::string& family, const std::string& user_loss, const Eigen::Map<Eigen::VectorXi> foldid, const Eigen::Map<Eigen::VectorXi> folds, const double& thresh, const int& maxit, const int& ne, const int& nx, const bool& implicit_xz, const double& cache_size, const bool& bounded_hessian, const bool& dual_gap, const bool& working_set, const bool& anderson, const bool& serpentine, const Rcpp::List& active_path, const bool& compact_folds, const int& ncores);
+RcppExport SEXP _xrnet_fitModelCVRcpp(SEXP xSEXP, SEXP mattype_xSEXP, SEXP ySEXP, SEXP extSEXP, SEXP is_sparse_extSEXP, SEXP fixedSEXP, SEXP weights_userSEXP, SEXP intrSEXP, SEXP stndSEXP, SEXP penalty_typeSEXP, SEXP cmultSEXP, SEXP quantilesSEXP, SEXP num_penaltySEXP, SEXP penalty_ratioSEXP, SEXP penalty_userSEXP, SEXP penalty_user_extSEXP, SEXP lower_clSEXP, SEXP upper_clSEXP, SEXP familySEXP, SEXP user_lossSEXP, SEXP foldidSEXP, SEXP foldsSEXP, SEXP threshSEXP, SEXP maxitSEXP, SEXP neSEXP, SEXP nxSEXP, SEXP implicit_xzSEXP, SEXP cache_sizeSEXP, SEXP bounded_hessianSEXP, SEXP dual_gapSEXP, SEXP working_setSEXP, SEXP andersonSEXP, SEXP serpentineSEXP, SEXP active_pathSEXP, SEXP compact_foldsSEXP, SEXP ncoresSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -36,7 +18,7 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< SEXP >::type ext(extSEXP);
     Rcpp::traits::input_parameter< const bool& >::type is_sparse_ext(is_sparse_extSEXP);
     Rcpp::traits::input_parameter< const Eigen::Map<Eigen::MatrixXd> >::type fixed(fixedSEXP);
-    Rcpp::traits::input_parameter< Eigen::VectorXd >::type weights_user(weights_userSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXd> >::type weights_user(weights_userSEXP);
     Rcpp::traits::input_parameter< const Rcpp::LogicalVector& >::type intr(intrSEXP);
     Rcpp::traits::input_parameter< const Rcpp::LogicalVector& >::type stnd(stndSEXP);
     Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXd> >::type penalty_type(penalty_typeSEXP);
@@ -46,22 +28,33 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type penalty_ratio(penalty_ratioSEXP);
     Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXd> >::type penalty_user(penalty_userSEXP);
     Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXd> >::type penalty_user_ext(penalty_user_extSEXP);
-    Rcpp::traits::input_parameter< Eigen::VectorXd >::type lower_cl(lower_clSEXP);
-    Rcpp::traits::input_parameter< Eigen::VectorXd >::type upper_cl(upper_clSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXd> >::type lower_cl(lower_clSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXd> >::type upper_cl(upper_clSEXP);
     Rcpp::traits::input_parameter< const std::string& >::type family(familySEXP);
     Rcpp::traits::input_parameter< const std::string& >::type user_loss(user_lossSEXP);
-    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXi> >::type test_idx(test_idxSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXi> >::type foldid(foldidSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXi> >::type folds(foldsSEXP);
     Rcpp::traits::input_parameter< const double& >::type thresh(threshSEXP);
     Rcpp::traits::input_parameter< const int& >::type maxit(maxitSEXP);
     Rcpp::traits::input_parameter< const int& >::type ne(neSEXP);
     Rcpp::traits::input_parameter< const int& >::type nx(nxSEXP);
-    rcpp_result_gen = Rcpp::wrap(fitModelCVRcpp(x, mattype_x, y, ext, is_sparse_ext, fixed, weights_user, intr, stnd, penalty_type, cmult, quantiles, num_penalty, penalty_ratio, penalty_user, penalty_user_ext, lower_cl, upper_cl, family, user_loss, test_idx, thresh, maxit, ne, nx));
+    Rcpp::traits::input_parameter< const bool& >::type implicit_xz(implicit_xzSEXP);
+    Rcpp::traits::input_parameter< const double& >::type cache_size(cache_sizeSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type bounded_hessian(bounded_hessianSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type dual_gap(dual_gapSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type working_set(working_setSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type anderson(andersonSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type serpentine(serpentineSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::List& >::type active_path(active_pathSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type compact_folds(compact_foldsSEXP);
+    Rcpp::traits::input_parameter< const int& >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(fitModelCVRcpp(x, mattype_x, y, ext, is_sparse_ext, fixed, weights_user, intr, stnd, penalty_type, cmult, quantiles, num_penalty, penalty_ratio, penalty_user, penalty_user_ext, lower_cl, upper_cl, family, user_loss, foldid, folds, thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, active_path, compact_folds, ncores));
     return rcpp_result_gen;
 END_RCPP
 }
 // fitModelRcpp
-Rcpp::List fitModelRcpp(SEXP x, const int& mattype_x, const Eigen::Map<Eigen::MatrixXd> y, SEXP ext, const bool& is_sparse_ext, const Eigen::Map<Eigen::MatrixXd> fixed, Eigen::VectorXd weights_user, const Rcpp::LogicalVector& intr, const Rcpp::LogicalVector& stnd, const Eigen::Map<Eigen::VectorXd> penalty_type, const Eigen::Map<Eigen::VectorXd> cmult, const Eigen::Map<Eigen::VectorXd> quantiles, const Rcpp::IntegerVector& num_penalty, const Rcpp::NumericVector& penalty_ratio, const Eigen::Map<Eigen::VectorXd> penalty_user, const Eigen::Map<Eigen::VectorXd> penalty_user_ext, Eigen::VectorXd lower_cl, Eigen::VectorXd upper_cl, const std::string& family, const double& thresh, const int& maxit, const int& ne, const int& nx);
-RcppExport SEXP _xrnet_fitModelRcpp(SEXP xSEXP, SEXP mattype_xSEXP, SEXP ySEXP, SEXP extSEXP, SEXP is_sparse_extSEXP, SEXP fixedSEXP, SEXP weights_userSEXP, SEXP intrSEXP, SEXP stndSEXP, SEXP penalty_typeSEXP, SEXP cmultSEXP, SEXP quantilesSEXP, SEXP num_penaltySEXP, SEXP penalty_ratioSEXP, SEXP penalty_userSEXP, SEXP penalty_user_extSEXP, SEXP lower_clSEXP, SEXP upper_clSEXP, SEXP familySEXP, SEXP threshSEXP, SEXP maxitSEXP, SEXP neSEXP, SEXP nxSEXP) {
+Rcpp::List fitModelRcpp(SEXP x, const int& mattype_x, const Eigen::Map<Eigen::MatrixXd> y, SEXP ext, const bool& is_sparse_ext, const Eigen::Map<Eigen::MatrixXd> fixed, Eigen::VectorXd weights_user, const Rcpp::LogicalVector& intr, const Rcpp::LogicalVector& stnd, const Eigen::Map<Eigen::VectorXd> penalty_type, const Eigen::Map<Eigen::VectorXd> cmult, const Eigen::Map<Eigen::VectorXd> quantiles, const Rcpp::IntegerVector& num_penalty, const Rcpp::NumericVector& penalty_ratio, const Eigen::Map<Eigen::VectorXd> penalty_user, const Eigen::Map<Eigen::VectorXd> penalty_user_ext, Eigen::VectorXd lower_cl, Eigen::VectorXd upper_cl, const std::string& family, const double& thresh, const int& maxit, const int& ne, const int& nx, const bool& implicit_xz, const double& cache_size, const bool& bounded_hessian, const bool& dual_gap, const bool& working_set, const bool& anderson, const bool& serpentine, const bool& sparse_path, const bool& seed_folds, const int& ncores);
+RcppExport SEXP _xrnet_fitModelRcpp(SEXP xSEXP, SEXP mattype_xSEXP, SEXP ySEXP, SEXP extSEXP, SEXP is_sparse_extSEXP, SEXP fixedSEXP, SEXP weights_userSEXP, SEXP intrSEXP, SEXP stndSEXP, SEXP penalty_typeSEXP, SEXP cmultSEXP, SEXP quantilesSEXP, SEXP num_penaltySEXP, SEXP penalty_ratioSEXP, SEXP penalty_userSEXP, SEXP penalty_user_extSEXP, SEXP lower_clSEXP, SEXP upper_clSEXP, SEXP familySEXP, SEXP threshSEXP, SEXP maxitSEXP, SEXP neSEXP, SEXP nxSEXP, SEXP implicit_xzSEXP, SEXP cache_sizeSEXP, SEXP bounded_hessianSEXP, SEXP dual_gapSEXP, SEXP working_setSEXP, SEXP andersonSEXP, SEXP serpentineSEXP, SEXP sparse_pathSEXP, SEXP seed_foldsSEXP, SEXP ncoresSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -88,15 +81,44 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< const int& >::type maxit(maxitSEXP);
     Rcpp::traits::input_parameter< const int& >::type ne(neSEXP);
     Rcpp::traits::input_parameter< const int& >::type nx(nxSEXP);
-    rcpp_result_gen = Rcpp::wrap(fitModelRcpp(x, mattype_x, y, ext, is_sparse_ext, fixed, weights_user, intr, stnd, penalty_type, cmult, quantiles, num_penalty, penalty_ratio, penalty_user, penalty_user_ext, lower_cl, upper_cl, family, thresh, maxit, ne, nx));
+    Rcpp::traits::input_parameter< const bool& >::type implicit_xz(implicit_xzSEXP);
+    Rcpp::traits::input_parameter< const double& >::type cache_size(cache_sizeSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type bounded_hessian(bounded_hessianSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type dual_gap(dual_gapSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type working_set(working_setSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type anderson(andersonSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type serpentine(serpentineSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type sparse_path(sparse_pathSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type seed_folds(seed_foldsSEXP);
+    Rcpp::traits::input_parameter< const int& >::type ncores(ncoresSEXP);
+    rcpp_result_gen = Rcpp::wrap(fitModelRcpp(x, mattype_x, y, ext, is_sparse_ext, fixed, weights_user, intr, stnd, penalty_type, cmult, quantiles, num_penalty, penalty_ratio, penalty_user, penalty_user_ext, lower_cl, upper_cl, family, thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores));
+    return rcpp_result_gen;
+END_RCPP
+}
+// computeResponseRcpp
+Eigen::MatrixXd computeResponseRcpp(SEXP X, const int& mattype_x, const Eigen::Map<Eigen::MatrixXd> Fixed, const Eigen::Map<Eigen::VectorXd> beta0, SEXP betas, const bool& is_sparse_betas, const Eigen::Map<Eigen::MatrixXd> gammas, const std::string& response_type, const std::string& family);
+RcppExport SEXP _xrnet_computeResponseRcpp(SEXP XSEXP, SEXP mattype_xSEXP, SEXP FixedSEXP, SEXP beta0SEXP, SEXP betasSEXP, SEXP is_sparse_betasSEXP, SEXP gammasSEXP, SEXP response_typeSEXP, SEXP familySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const int& >::type mattype_x(mattype_xSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::MatrixXd> >::type Fixed(FixedSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::VectorXd> >::type beta0(beta0SEXP);
+    Rcpp::traits::input_parameter< SEXP >::type betas(betasSEXP);
+    Rcpp::traits::input_parameter< const bool& >::type is_sparse_betas(is_sparse_betasSEXP);
+    Rcpp::traits::input_parameter< const Eigen::Map<Eigen::MatrixXd> >::type gammas(gammasSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type response_type(response_typeSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type family(familySEXP);
+    rcpp_result_gen = Rcpp::wrap(computeResponseRcpp(X, mattype_x, Fixed, beta0, betas, is_sparse_betas, gammas, response_type, family));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_xrnet_computeResponseRcpp", (DL_FUNC) &_xrnet_computeResponseRcpp, 8},
-    {"_xrnet_fitModelCVRcpp", (DL_FUNC) &_xrnet_fitModelCVRcpp, 25},
-    {"_xrnet_fitModelRcpp", (DL_FUNC) &_xrnet_fitModelRcpp, 23},
+    {"_xrnet_fitModelCVRcpp", (DL_FUNC) &_xrnet_fitModelCVRcpp, 36},
+    {"_xrnet_fitModelRcpp", (DL_FUNC) &_xrnet_fitModelRcpp, 33},
+    {"_xrnet_computeResponseRcpp", (DL_FUNC) &_xrnet_computeResponseRcpp, 9},
     {NULL, NULL, 0}
 };
 
@@ -0,0 +1,26 @@
+#ifndef SINGLE_PRECISION_H
+#define SINGLE_PRECISION_H
+
+#include <RcppEigen.h>
+#include <bigmemory/MatrixAccessor.hpp>
+#include "CoordDescTypes.h"
+
+// map dense x (R matrix or big.matrix) in single precision, double precision
+// data is converted once into storage while float big.matrix objects are
+// mapped without a copy
+inline MapMatF map_single_precision(SEXP x, Eigen::MatrixXf & storage) {
+    if (Rf_isS4(x)) {
+        Rcpp::S4 x_info(x);
+        Rcpp::XPtr<BigMatrix> xptr((SEXP) x_info.slot("address"));
+        if (xptr->matrix_type() == 6) {
+            return MapMatF((const float *) xptr->matrix(), xptr->nrow(), xptr->ncol());
+        }
+        storage = MapMat((const double *) xptr->matrix(), xptr->nrow(), xptr->ncol()).cast<float>();
+    } else {
+        Rcpp::NumericMatrix x_mat(x);
+        storage = MapMat((const double *) &x_mat[0], x_mat.rows(), x_mat.cols()).cast<float>();
+    }
+    return MapMatF(storage.data(), storage.rows(), storage.cols());
+}
+
+#endif // SINGLE_PRECISION_H
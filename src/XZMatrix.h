@@ -0,0 +1,81 @@
+#ifndef XZ_MATRIX_H
+#define XZ_MATRIX_H
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include "Kernels.h"
+
+// Column access to the 2nd level design XZ, either stored as a dense
+// n x q matrix or applied implicitly from X, where column j is
+// X * s_j - offset_j and s_j = diag(xs_x) * z_j (see create_XZ_implicit)
+template <typename T>
+class XZMatrix {
+
+    typedef Eigen::Map<const Eigen::MatrixXd> MapMat;
+    typedef Eigen::Map<const Eigen::VectorXd> MapVec;
+    typedef Eigen::Map<const Eigen::SparseMatrix<double> > MapSpWts;
+
+private:
+    bool implicit;
+    MapMat XZ;
+    const T * X;
+    MapSpWts S;
+    MapVec offset;
+    mutable Eigen::VectorXd col_buf;
+
+public:
+    // constructor (materialized XZ)
+    XZMatrix(const Eigen::Ref<const Eigen::MatrixXd> & XZ_) :
+    implicit(false),
+    XZ(XZ_.data(), XZ_.rows(), XZ_.cols()),
+    X(nullptr),
+    S(0, 0, 0, nullptr, nullptr, nullptr),
+    offset(nullptr, 0)
+    {};
+
+    // constructor (implicit XZ)
+    XZMatrix(const T & X_,
+             const Eigen::SparseMatrix<double> & S_,
+             const Eigen::Ref<const Eigen::VectorXd> & offset_) :
+    implicit(true),
+    XZ(nullptr, 0, 0),
+    X(&X_),
+    S(S_.rows(), S_.cols(), S_.nonZeros(), S_.outerIndexPtr(),
+      S_.innerIndexPtr(), S_.valuePtr()),
+    offset(offset_.data(), offset_.size()),
+    col_buf(X_.rows())
+    {};
+
+    bool isImplicit() const {return implicit;}
+    int rows() const {return implicit ? X->rows() : XZ.rows();}
+    int cols() const {return implicit ? S.cols() : XZ.cols();}
+
+    // j-th column of XZ, in implicit mode the column is computed into a
+    // workspace owned by this object and is valid until the next call
+    MapVec col(const int & j) const {
+        if (!implicit) {
+            return MapVec(XZ.data() + XZ.rows() * j, XZ.rows());
+        }
+        col_buf.setConstant(-offset[j]);
+        for (MapSpWts::InnerIterator it(S, j); it; ++it) {
+            axpy_centered(it.value(), X->col(it.index()), 0.0, col_buf);
+        }
+        return MapVec(col_buf.data(), col_buf.size());
+    }
+
+    // out = XZ^T * r, in implicit mode computed from xtr = X^T * r and
+    // r_sum = sum(r) as S^T * xtr - offset * r_sum (a p x q product)
+    void crossprod(const Eigen::Ref<const Eigen::VectorXd> & r,
+                   const Eigen::Ref<const Eigen::VectorXd> & xtr,
+                   const double & r_sum,
+                   Eigen::Ref<Eigen::VectorXd> out) const {
+        if (implicit) {
+            out.noalias() = S.transpose() * xtr;
+            out -= r_sum * offset;
+        } else {
+            out.noalias() = XZ.transpose() * r;
+        }
+    }
+};
+
+#endif // XZ_MATRIX_H
@@ -1,8 +1,9 @@
 #ifndef XRNET_H
 #define XRNET_H
 
-#include <RcppEigen.h>
-#include "CoordSolver.h"
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <vector>
 
 template <typename TX, typename TZ>
 class Xrnet {
@@ -11,6 +12,7 @@ class Xrnet {
     typedef Eigen::MatrixXd MatXd;
     typedef Eigen::Map<const Eigen::VectorXd> MapVec;
     typedef Eigen::Map<const Eigen::MatrixXd> MapMat;
+    typedef Eigen::SparseVector<double> SpVec;
 
 protected:
     const int n;
@@ -31,6 +33,37 @@ protected:
     VecXd alpha0;
     MatXd alphas;
     VecXd strong_sum;
+    bool sparse_path;
+    std::vector<SpVec> betas_sp;
+    std::vector<SpVec> alphas_sp;
+    bool save_active;
+    std::vector<Eigen::Triplet<double> > active_nz;
+
+    // compressed matrix of estimates stored as sparse columns, ordered so
+    // the 1st level penalty varies fastest (as in the arrays returned to R)
+    static Eigen::SparseMatrix<double> assemble_path(const std::vector<SpVec> & cols,
+                                                     const int & nrow,
+                                                     const int & num_penalty_ext) {
+        const int num_combn = cols.size();
+        const int num_penalty = num_combn / num_penalty_ext;
+        Eigen::SparseMatrix<double> path(nrow, num_combn);
+        Eigen::VectorXi nnz(num_combn);
+        for (int m = 0; m < num_penalty; ++m) {
+            for (int m2 = 0; m2 < num_penalty_ext; ++m2) {
+                nnz[m2 * num_penalty + m] = cols[m * num_penalty_ext + m2].nonZeros();
+            }
+        }
+        path.reserve(nnz);
+        for (int m = 0; m < num_penalty; ++m) {
+            for (int m2 = 0; m2 < num_penalty_ext; ++m2) {
+                for (SpVec::InnerIterator it(cols[m * num_penalty_ext + m2]); it; ++it) {
+                    path.insert(it.index(), m2 * num_penalty + m) = it.value();
+                }
+            }
+        }
+        path.makeCompressed();
+        return path;
+    };
 
 public:
     // constructor (dense external)
@@ -47,7 +80,8 @@ public:
           const double * xsptr,
           const double & ym_,
           const double & ys_,
-          const int & num_penalty_) :
+          const int & num_penalty_,
+          const bool & sparse_path_ = false) :
     n(n_),
     nv_x(nv_x_),
     nv_fixed(nv_fixed_),
@@ -59,13 +93,23 @@ public:
     cent(centptr, nv_total_),
     xs(xsptr, nv_total_),
     ym(ym_),
-    ys(ys_)
+    ys(ys_),
+    sparse_path(sparse_path_),
+    save_active(false)
     {
         beta0 = Eigen::VectorXd::Zero(num_penalty_);
-        betas = Eigen::MatrixXd::Zero(nv_x_, num_penalty_);
         gammas = Eigen::MatrixXd::Zero(nv_fixed_, num_penalty_);
         alpha0 = Eigen::VectorXd::Zero(num_penalty_);
-        alphas = Eigen::MatrixXd::Zero(nv_ext_, num_penalty_);
+        if (sparse_path) {
+            betas.resize(nv_x_, 0);
+            alphas.resize(nv_ext_, 0);
+            betas_sp.resize(num_penalty_);
+            alphas_sp.resize(num_penalty_);
+        }
+        else {
+            betas = Eigen::MatrixXd::Zero(nv_x_, num_penalty_);
+            alphas = Eigen::MatrixXd::Zero(nv_ext_, num_penalty_);
+        }
         strong_sum = Eigen::VectorXd::Zero(num_penalty_);
     };
 
@@ -83,7 +127,8 @@ public:
           const double * xsptr,
           const double & ym_,
           const double & ys_,
-          const int & num_penalty_) :
+          const int & num_penalty_,
+          const bool & sparse_path_ = false) :
         n(n_),
         nv_x(nv_x_),
         nv_fixed(nv_fixed_),
@@ -95,13 +140,23 @@ public:
         cent(centptr, nv_total_),
         xs(xsptr, nv_total_),
         ym(ym_),
-        ys(ys_)
+        ys(ys_),
+        sparse_path(sparse_path_),
+        save_active(false)
     {
         beta0 = Eigen::VectorXd::Zero(num_penalty_);
-        betas = Eigen::MatrixXd::Zero(nv_x_, num_penalty_);
         gammas = Eigen::MatrixXd::Zero(nv_fixed_, num_penalty_);
         alpha0 = Eigen::VectorXd::Zero(num_penalty_);
-        alphas = Eigen::MatrixXd::Zero(nv_ext_, num_penalty_);
+        if (sparse_path) {
+            betas.resize(nv_x_, 0);
+            alphas.resize(nv_ext_, 0);
+            betas_sp.resize(num_penalty_);
+            alphas_sp.resize(num_penalty_);
+        }
+        else {
+            betas = Eigen::MatrixXd::Zero(nv_x_, num_penalty_);
+            alphas = Eigen::MatrixXd::Zero(nv_ext_, num_penalty_);
+        }
         strong_sum = Eigen::VectorXd::Zero(num_penalty_);
     };
 
@@ -118,6 +173,24 @@ public:
     VecXd getAlpha0(){return alpha0;};
     MatXd getAlphas(){return alphas;};
 
+    // estimates of x and external variables when stored as sparse columns
+    Eigen::SparseMatrix<double> getBetasSparse(const int & num_penalty_ext) {
+        return assemble_path(betas_sp, nv_x, num_penalty_ext);
+    };
+    Eigen::SparseMatrix<double> getAlphasSparse(const int & num_penalty_ext) {
+        return assemble_path(alphas_sp, nv_ext, num_penalty_ext);
+    };
+
+    // nonzero estimates of all variables (before 2nd level variables are
+    // folded into betas) for each penalty, used to seed cv folds
+    void setSaveActive(const bool & save_active_) {save_active = save_active_;};
+    Eigen::SparseMatrix<double> getActivePath() {
+        Eigen::SparseMatrix<double> active_path(xs.size(), beta0.size());
+        active_path.setFromTriplets(active_nz.begin(), active_nz.end());
+        active_path.makeCompressed();
+        return active_path;
+    };
+
     // save results for single penalty
     virtual void add_results(double b0, VecXd coef, const int & idx) {
 
@@ -125,12 +198,28 @@ public:
         coef = ys * coef.cwiseProduct(xs);
         b0 *= ys;
 
+        // nonzero pattern (penalties may be added from several threads)
+        if (save_active) {
+#ifdef _OPENMP
+            #pragma omp critical
+#endif
+            for (int k = 0; k < coef.size(); ++k) {
+                if (coef[k] != 0.0) active_nz.push_back(Eigen::Triplet<double>(k, idx, 1.0));
+            }
+        }
+
         // get external coefficients
         if (nv_ext > 0) {
-            alphas.col(idx) = coef.tail(nv_ext);
+            if (sparse_path) {
+                alphas_sp[idx] = coef.tail(nv_ext).sparseView();
+            }
+            else {
+                alphas.col(idx) = coef.tail(nv_ext);
+            }
         }
 
         // unstandardize predictors w/ external data (x)
+        VecXd beta_idx;
         if (nv_ext + intr_ext > 0) {
             VecXd z_alpha = Eigen::VectorXd::Zero(nv_x);
             if (intr_ext) {
@@ -139,10 +228,10 @@ public:
             if (nv_ext > 0) {
                 z_alpha += ext * coef.tail(nv_ext);
             }
-            betas.col(idx) = z_alpha.cwiseProduct(xs.head(nv_x)) + coef.head(nv_x);
+            beta_idx = z_alpha.cwiseProduct(xs.head(nv_x)) + coef.head(nv_x);
         }
         else {
-            betas.col(idx) = coef.head(nv_x);
+            beta_idx = coef.head(nv_x);
         }
 
         // unstandardize predictors w/o external data (fixed)
@@ -153,20 +242,28 @@ public:
         // compute 2nd level intercepts
         if (intr_ext) {
             if (nv_ext > 0) {
-                alpha0[idx] = betas.col(idx).mean() - xm.tail(nv_ext).dot(alphas.col(idx));
+                alpha0[idx] = beta_idx.mean() - xm.tail(nv_ext).dot(coef.tail(nv_ext));
             }
             else {
-                alpha0[idx] = betas.col(idx).mean();
+                alpha0[idx] = beta_idx.mean();
             }
         }
 
         // compute 1st level intercepts
         if (intr) {
-            beta0[idx] = (ym + b0) - cent.head(nv_x).dot(betas.col(idx));
+            beta0[idx] = (ym + b0) - cent.head(nv_x).dot(beta_idx);
             if (nv_fixed > 0) {
                 beta0[idx] -= cent.segment(nv_x, nv_fixed).dot(gammas.col(idx));
             }
         }
+
+        // only nonzero estimates are kept if the path is stored sparse
+        if (sparse_path) {
+            betas_sp[idx] = beta_idx.sparseView();
+        }
+        else {
+            betas.col(idx) = beta_idx;
+        }
     }
 };
 
@@ -1,9 +1,16 @@
 #ifndef XRNET_CV_H
 #define XRNET_CV_H
 
-#include <RcppEigen.h>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
 #include <unordered_map>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
 #include "Xrnet.h"
+#include "Kernels.h"
 
 template <typename TX, typename TZ>
 class XrnetCV : public Xrnet<TX, TZ>  {
@@ -13,17 +20,20 @@ class XrnetCV : public Xrnet<TX, TZ>  {
     typedef Eigen::Map<const Eigen::VectorXd> MapVec;
     typedef Eigen::Map<const Eigen::MatrixXd> MapMat;
     typedef Eigen::MappedSparseMatrix<double> MapSpMat;
-    typedef double (*lossPtr)(const Eigen::Ref<const Eigen::MatrixXd> &,
-                              const Eigen::Ref<const Eigen::VectorXd> &,
-                              const Eigen::Ref<const Eigen::VectorXi> &);
+    typedef Eigen::Matrix<typename TX::Scalar, Eigen::Dynamic, Eigen::Dynamic> MatX;
+    typedef void (*lossPtr)(const Eigen::Ref<const Eigen::VectorXd> &,
+                            const Eigen::Ref<const Eigen::MatrixXd> &,
+                            Eigen::Ref<Eigen::VectorXd>);
 
 protected:
-    Eigen::Map<const Eigen::VectorXi> test_idx;
     TX X;
     MapMat Fixed;
     MapMat y;
     VecXd error_mat;
     lossPtr loss_func;
+    VecXd beta0_path;
+    std::vector<Eigen::Triplet<double> > betas_nz;
+    MatXd gammas_path;
     using Xrnet<TX, TZ>::n;
     using Xrnet<TX, TZ>::ym;
     using Xrnet<TX, TZ>::ys;
@@ -58,8 +68,7 @@ public:
             const int & num_penalty_,
             const std::string & family_,
             const std::string & user_loss_,
-            const Eigen::Ref<const Eigen::VectorXi> & test_idx_,
-            const Eigen::Ref<const Eigen::MatrixXd> & X_,
+            const Eigen::Ref<const MatX> & X_,
             const Eigen::Ref<const Eigen::MatrixXd> & Fixed_,
             const Eigen::Ref<const Eigen::MatrixXd> & y_) :
     Xrnet<TX, TZ>(
@@ -77,12 +86,13 @@ public:
             ym_,
             ys_,
             1),
-            test_idx(test_idx_.data(), test_idx_.size()),
             X(X_.data(), n_, X_.cols()),
             Fixed(Fixed_.data(), n, Fixed_.cols()),
             y(y_.data(), n_, y_.cols())
             {
                 error_mat = Eigen::VectorXd::Zero(num_penalty_);
+                beta0_path = Eigen::VectorXd::Zero(num_penalty_);
+                gammas_path = Eigen::MatrixXd::Zero(nv_fixed_, num_penalty_);
                 loss_func = select_loss(family_, user_loss_);
             };
 
@@ -103,7 +113,6 @@ public:
             const int & num_penalty_,
             const std::string & family_,
             const std::string & user_loss_,
-            const Eigen::Ref<const Eigen::VectorXi> & test_idx_,
             const MapSpMat X_,
             const Eigen::Ref<const Eigen::MatrixXd> & Fixed_,
             const Eigen::Ref<const Eigen::MatrixXd> & y_) :
@@ -122,20 +131,43 @@ public:
                 ym_,
                 ys_,
                 1),
-                test_idx(test_idx_.data(), test_idx_.size()),
                 X(X_),
                 Fixed(Fixed_.data(), n, Fixed_.cols()),
                 y(y_.data(), n_, y_.cols())
                 {
                     error_mat = Eigen::VectorXd::Zero(num_penalty_);
+                    beta0_path = Eigen::VectorXd::Zero(num_penalty_);
+                    gammas_path = Eigen::MatrixXd::Zero(nv_fixed_, num_penalty_);
                     loss_func = select_loss(family_, user_loss_);
                 };
 
     // destructor
     virtual ~XrnetCV(){};
 
-    // getters
-    MatXd get_error_mat(){return error_mat;};
+    // errors for all penalties, predictions for the test rows are computed in
+    // blocks of penalties from the sparse matrix of saved coefficients
+    MatXd get_error_mat() {
+        const int num_penalty = beta0_path.size();
+        Eigen::SparseMatrix<double> betas_path(nv_x, num_penalty);
+        betas_path.setFromTriplets(betas_nz.begin(), betas_nz.end());
+        const int block_size = std::max(1, std::min(num_penalty, 1048576 / std::max(1, n)));
+        MatXd yhat(n, block_size);
+        for (int start = 0; start < num_penalty; start += block_size) {
+            const int len = std::min(block_size, num_penalty - start);
+            auto yhat_block = yhat.leftCols(len);
+            yhat_block = Eigen::VectorXd::Ones(n) * beta0_path.segment(start, len).transpose();
+            for (int j = 0; j < len; ++j) {
+                for (Eigen::SparseMatrix<double>::InnerIterator it(betas_path, start + j); it; ++it) {
+                    axpy_centered(it.value(), X.col(it.index()), 0.0, yhat_block.col(j));
+                }
+            }
+            if (nv_fixed > 0) {
+                yhat_block.noalias() += Fixed * gammas_path.middleCols(start, len);
+            }
+            loss_func(y.col(0), yhat_block, error_mat.segment(start, len));
+        }
+        return error_mat;
+    };
 
     // save results for single penalty
     virtual void add_results(double b0, VecXd coef, const int & idx) {
@@ -177,15 +209,16 @@ public:
             }
         }
 
-        // compute predicted values
-        VecXd yhat = Eigen::VectorXd::Constant(n, beta0[0]);
-        yhat += X * betas.sparseView();
+        // save estimates, test predictions use nonzero coefficients only
+        beta0_path[idx] = beta0[0];
+        for (int k = 0; k < nv_x; ++k) {
+            if (betas(k, 0) != 0.0) {
+                betas_nz.push_back(Eigen::Triplet<double>(k, idx, betas(k, 0)));
+            }
+        }
         if (nv_fixed > 0) {
-            yhat += Fixed * gammas;
+            gammas_path.col(idx) = gammas.col(0);
         }
-
-        // compute error for test data
-        error_mat[idx] = loss_func(y, yhat, test_idx);
     }
 
     // returns pointer to appropriate loss function based on family / user_loss
@@ -222,68 +255,56 @@ public:
         return loss_func;
     }
 
-    static double mean_squared_error(const Eigen::Ref<const Eigen::MatrixXd> & actual,
-                                     const Eigen::Ref<const Eigen::VectorXd> & predicted,
-                                     const Eigen::Ref<const Eigen::VectorXi> & test_idx) {
-        double error = 0.0;
-        for (int i = 0; i < test_idx.size(); ++i) {
-            error += std::pow(actual(test_idx[i], 0) - predicted[test_idx[i]], 2) / test_idx.size();
-        }
-        return error;
+    // errors of each column of predicted values (one per penalty)
+    static void mean_squared_error(const Eigen::Ref<const Eigen::VectorXd> & actual,
+                                   const Eigen::Ref<const Eigen::MatrixXd> & predicted,
+                                   Eigen::Ref<Eigen::VectorXd> error) {
+        error = (predicted.colwise() - actual).array().square().colwise().mean().transpose();
     }
 
-    static double mean_absolute_error(const Eigen::Ref<const Eigen::MatrixXd> & actual,
-                                      const Eigen::Ref<const Eigen::VectorXd> & predicted,
-                                      const Eigen::Ref<const Eigen::VectorXi> & test_idx) {
-        double error = 0.0;
-        for (int i = 0; i < test_idx.size(); ++i) {
-            error += std::abs(actual(test_idx[i], 0) - predicted[test_idx[i]]) / test_idx.size();
-        }
-        return error;
+    static void mean_absolute_error(const Eigen::Ref<const Eigen::VectorXd> & actual,
+                                    const Eigen::Ref<const Eigen::MatrixXd> & predicted,
+                                    Eigen::Ref<Eigen::VectorXd> error) {
+        error = (predicted.colwise() - actual).array().abs().colwise().mean().transpose();
     }
 
-    static double auc(const Eigen::Ref<const Eigen::MatrixXd> & actual,
-                      const Eigen::Ref<const Eigen::VectorXd> & predicted,
-                      const Eigen::Ref<const Eigen::VectorXi> & test_idx) {
+    static void auc(const Eigen::Ref<const Eigen::VectorXd> & actual,
+                    const Eigen::Ref<const Eigen::MatrixXd> & predicted,
+                    Eigen::Ref<Eigen::VectorXd> error) {
 
-        // subset to test y / yhat
-        const int test_size = test_idx.size();
-        Eigen::VectorXd actual_sub(test_size);
-        Eigen::VectorXd pred_sub(test_size);
-        for (int i = 0; i < test_size; ++i) {
-            actual_sub[i] = actual(test_idx[i], 0);
-            pred_sub[i] = predicted[test_idx[i]];
-        }
+        // number of cases is the same for all penalties
+        const int n = actual.size();
+        const int n1 = (actual.array() == 1).count();
+        std::vector<int> indx(n);
+
+        for (int j = 0; j < predicted.cols(); ++j) {
 
-        // get rankings
-        const int n = pred_sub.size();
-        std::vector<size_t> indx(n);
-        std::iota(indx.begin(), indx.end(), 0);
-        std::sort(indx.begin(), indx.end(), [&pred_sub](int i1, int i2) {
-            return pred_sub[i1] < pred_sub[i2];
-        });
+            // get rankings
+            const auto pred = predicted.col(j);
+            std::iota(indx.begin(), indx.end(), 0);
+            std::sort(indx.begin(), indx.end(), [&pred](int i1, int i2) {
+                return pred[i1] < pred[i2];
+            });
 
-        // compute mann whitney u --> use to get auc
-        int n1 = 0;
-        double rank_sum = 0;
-        for (int i = 0; i < n; ++i) {
-            if (actual_sub[indx[i]] == 1) {
-                ++n1;
-                rank_sum += i + 1;
+            // compute mann whitney u --> use to get auc
+            double rank_sum = 0;
+            for (int i = 0; i < n; ++i) {
+                if (actual[indx[i]] == 1) {
+                    rank_sum += i + 1;
+                }
             }
+            double u_value = rank_sum - (n1 * (n1 + 1)) / 2.0;
+            error[j] = u_value / (n1 * (n - n1));
         }
-        double u_value = rank_sum - (n1 * (n1 + 1)) / 2.0;
-        return u_value / (n1 * (n - n1));
     }
 
-    static double deviance_binomial(const Eigen::Ref<const Eigen::MatrixXd> & actual,
-                                    const Eigen::Ref<const Eigen::VectorXd> & predicted,
-                                    const Eigen::Ref<const Eigen::VectorXi> & test_idx) {
-        double error = 0.0;
-        for (int i = 0; i < test_idx.size(); ++i){
-            error += (actual(test_idx[i], 0) * predicted[test_idx[i]] - log(1.0 + exp(predicted[test_idx[i]]))) / test_idx.size();
+    static void deviance_binomial(const Eigen::Ref<const Eigen::VectorXd> & actual,
+                                  const Eigen::Ref<const Eigen::MatrixXd> & predicted,
+                                  Eigen::Ref<Eigen::VectorXd> error) {
+        const int n = actual.size();
+        for (int j = 0; j < predicted.cols(); ++j) {
+            error[j] = -2 * binomial_loglik(actual, predicted.col(j)) / n;
         }
-        return -2 * error;
     }
 };
 
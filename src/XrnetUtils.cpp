@@ -1,8 +1,4 @@
 #include "XrnetUtils.h"
-#include <bigmemory/MatrixAccessor.hpp>
-
-typedef Eigen::Map<const Eigen::MatrixXd> MapMat;
-typedef Eigen::MappedSparseMatrix<double> MapSpMat;
 
 void compute_penalty(Eigen::Ref<Eigen::VectorXd> path,
                      const Eigen::Ref<const Eigen::VectorXd> & penalty_user,
@@ -36,31 +32,3 @@ void compute_penalty(Eigen::Ref<Eigen::VectorXd> path,
         path = penalty_user / ys;
     }
 }
-
-// [[Rcpp::export]]
-Eigen::MatrixXd computeResponseRcpp(SEXP X,
-                                    const int & mattype_x,
-                                    const Eigen::Map<Eigen::MatrixXd> Fixed,
-                                    const Eigen::Map<Eigen::VectorXd> beta0,
-                                    const Eigen::Map<Eigen::MatrixXd> betas,
-                                    const Eigen::Map<Eigen::MatrixXd> gammas,
-                                    const std::string & response_type,
-                                    const std::string & family) {
-
-    if (mattype_x == 1) {
-        Rcpp::NumericMatrix x_mat(X);
-        MapMat xmap((const double *) &x_mat[0], x_mat.rows(), x_mat.cols());
-        return computeResponse<MapMat>(xmap, Fixed, beta0, betas, gammas, response_type, family);
-    } else if (mattype_x == 2) {
-        Rcpp::S4 x_info(X);
-        Rcpp::XPtr<BigMatrix> xptr((SEXP) x_info.slot("address"));
-        MapMat xmap((const double *)xptr->matrix(), xptr->nrow(), xptr->ncol());
-        return computeResponse<MapMat>(xmap, Fixed, beta0, betas, gammas, response_type, family);
-    } else {
-        return computeResponse<MapSpMat>(Rcpp::as<MapSpMat>(X), Fixed, beta0, betas, gammas, response_type, family);
-    }
-}
-
-double logit_inv(double x) {
-    return 1 / (1 + std::exp(-x));
-}
@@ -1,8 +1,12 @@
 #ifndef XRNET_UTILS_H
 #define XRNET_UTILS_H
 
-#include <RcppEigen.h>
-#include <string.h>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <string>
+#include <cmath>
+#include <limits>
+#include "Kernels.h"
 
 void compute_penalty(Eigen::Ref<Eigen::VectorXd> path,
                      const Eigen::Ref<const Eigen::VectorXd> & penalty_user,
@@ -14,26 +18,28 @@ void compute_penalty(Eigen::Ref<Eigen::VectorXd> path,
                      const int & end,
                      const double & ys);
 
-double logit_inv(double x);
-
-template <typename TX>
+// betas are dense or, for paths stored sparse, column compressed
+template <typename TX, typename TB>
 Eigen::MatrixXd computeResponse(const TX & X,
                                 const Eigen::Ref<const Eigen::MatrixXd> & Fixed,
                                 const Eigen::Ref<const Eigen::VectorXd> & beta0,
-                                const Eigen::Ref<const Eigen::MatrixXd> & betas,
+                                const TB & betas,
                                 const Eigen::Ref<const Eigen::MatrixXd> & gammas,
                                 const std::string & response_type,
                                 const std::string & family) {
 
-    Eigen::MatrixXd pred(X.rows(), betas.cols());
+    Eigen::MatrixXd pred = Eigen::VectorXd::Constant(X.rows(), 1.0) * beta0.transpose();
+    multiply_add(X, betas, pred);
     if (gammas.cols() > 0)
-        pred = Eigen::VectorXd::Constant(X.rows(), 1.0) * beta0.transpose() + X * betas + Fixed * gammas;
-    else
-        pred = Eigen::VectorXd::Constant(X.rows(), 1.0) * beta0.transpose() + X * betas;
+        pred.noalias() += Fixed * gammas;
 
     if (response_type == "response") {
         if (family == "binomial") {
-            pred = pred.unaryExpr(&logit_inv);
+            Eigen::MatrixXd prob(pred.rows(), pred.cols());
+            Eigen::Map<const Eigen::VectorXd> eta_vec(pred.data(), pred.size());
+            Eigen::Map<Eigen::VectorXd> prob_vec(prob.data(), prob.size());
+            logistic(eta_vec, std::numeric_limits<double>::infinity(), prob_vec);
+            return prob;
         }
     }
     return pred;
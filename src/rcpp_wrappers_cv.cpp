@@ -1,10 +1,15 @@
-#include <string.h>
+#include <RcppEigen.h>
+#include <bigmemory/MatrixAccessor.hpp>
+#include <string>
+#include <memory>
 #include "DataFunctions.h"
 #include "XrnetCV.h"
 #include "XrnetUtils.h"
 #include "CoordDescTypes.h"
+#include "SinglePrecision.h"
 #include "GaussianSolver.h"
 #include "BinomialSolver.h"
+// [[Rcpp::depends(RcppEigen, BH, bigmemory)]]
 
 template <typename TX, typename TZ>
 Eigen::VectorXd fitModelCV(const TX & x,
@@ -13,24 +18,35 @@ Eigen::VectorXd fitModelCV(const TX & x,
                            const TZ & ext,
                            const Eigen::Ref<const Eigen::MatrixXd> & fixed,
                            Eigen::VectorXd weights_user,
-                           const Rcpp::LogicalVector & intr,
-                           const Rcpp::LogicalVector & stnd,
+                           const std::vector<bool> & intr,
+                           const std::vector<bool> & stnd,
                            const Eigen::Ref<const Eigen::VectorXd> & penalty_type,
                            const Eigen::Ref<const Eigen::VectorXd> & cmult,
                            const Eigen::Ref<const Eigen::VectorXd> & quantiles,
-                           const Rcpp::IntegerVector & num_penalty,
-                           const Rcpp::NumericVector & penalty_ratio,
+                           const Eigen::Ref<const Eigen::VectorXi> & num_penalty,
+                           const Eigen::Ref<const Eigen::VectorXd> & penalty_ratio,
                            const Eigen::Ref<const Eigen::VectorXd> & penalty_user,
                            const Eigen::Ref<const Eigen::VectorXd> & penalty_user_ext,
                            Eigen::VectorXd lower_cl,
                            Eigen::VectorXd upper_cl,
                            const std::string & family,
                            const std::string & user_loss,
-                           const Eigen::Ref<const Eigen::VectorXi> & test_idx,
+                           const TX & x_test,
+                           const Eigen::Ref<const Eigen::MatrixXd> & y_test,
+                           const Eigen::Ref<const Eigen::MatrixXd> & fixed_test,
                            const double & thresh,
                            const int & maxit,
                            const int & ne,
-                           const int & nx) {
+                           const int & nx,
+                           const bool & implicit_xz,
+                           const double & cache_size,
+                           const bool & bounded_hessian,
+                           const bool & dual_gap,
+                           const bool & working_set,
+                           const bool & anderson,
+                           const bool & serpentine,
+                           const Eigen::Ref<const Eigen::VectorXi> & seed_ptr,
+                           const Eigen::Ref<const Eigen::VectorXi> & seed_idx) {
 
     // initialize objects to hold means, variances, sds of all variables
     const int n = x.rows();
@@ -49,14 +65,27 @@ Eigen::VectorXd fitModelCV(const TX & x,
     // scale user weights
     weights_user.array() = weights_user.array() / weights_user.sum();
 
-    // compute moments of matrices and create XZ (if external data present)
+    // compute moments of matrices and create XZ (if external data present),
+    // XZ is applied from x / ext on the fly instead of stored if implicit_xz
     const bool center_x = intr[0] && !is_sparse_x;
     compute_moments(x, weights_user, xm, cent, xv, xs, center_x, stnd[0], 0);
     compute_moments(fixedmap, weights_user, xm, cent, xv, xs, center_x, stnd[0], nv_x);
-    const Eigen::MatrixXd xz = create_XZ(
-        x, ext, xm, cent, weights_user,
-        xv, xs, intr[1], stnd[1], nv_x + nv_fixed
-    );
+    Eigen::MatrixXd xz_dense;
+    Eigen::SparseMatrix<double> xz_weights;
+    Eigen::VectorXd xz_offset;
+    if (implicit_xz) {
+        xz_weights = create_XZ_implicit(
+            x, ext, xm, cent, weights_user, xv, xs,
+            xz_offset, intr[1], stnd[1], nv_x + nv_fixed
+        );
+    } else {
+        xz_dense = create_XZ(
+            x, ext, xm, cent, weights_user, xv,
+            xs, intr[1], stnd[1], nv_x + nv_fixed
+        );
+    }
+    const XZMatrix<TX> xz = implicit_xz ?
+        XZMatrix<TX>(x, xz_weights, xz_offset) : XZMatrix<TX>(xz_dense);
 
     // choose solver based on outcome
     std::unique_ptr<CoordSolver<TX> > solver;
@@ -66,7 +95,8 @@ Eigen::VectorXd fitModelCV(const TX & x,
                     y, x, fixedmap, xz, cent.data(), xv.data(), xs.data(),
                     weights_user, intr[0], penalty_type.data(),
                     cmult.data(), quantiles, upper_cl.data(),
-                    lower_cl.data(), ne, nx, thresh, maxit
+                    lower_cl.data(), ne, nx, thresh, maxit,
+                    dual_gap
             )
         );
 
@@ -77,17 +107,28 @@ Eigen::VectorXd fitModelCV(const TX & x,
                     y, x, fixedmap, xz, cent.data(), xv.data(),
                     xs.data(), weights_user, intr[0], penalty_type.data(),
                     cmult.data(), quantiles, upper_cl.data(),
-                    lower_cl.data(), ne, nx, thresh, maxit
+                    lower_cl.data(), ne, nx, thresh, maxit,
+                    bounded_hessian
             )
         );
     }
-    // Object to hold results for all penalty combinations
+
+    // memory for packed copies of active columns
+    solver->setCacheSize(cache_size);
+
+    // coordinate descent over a growing working set of strong features
+    solver->setWorkingSet(working_set);
+
+    // anderson extrapolation of passes over the active set
+    solver->setAnderson(anderson);
+
+    // Object to hold results for all penalty combinations (scored on test rows)
     const int num_combn = num_penalty[0] * num_penalty[1];
     XrnetCV<TX, TZ> results = XrnetCV<TX, TZ>(
-        n, nv_x, nv_fixed, nv_ext, nv_total,
+        x_test.rows(), nv_x, nv_fixed, nv_ext, nv_total,
         intr[0], intr[1], ext, xm.data(), cent.data(),
         xs.data(), solver->getYm(), solver->getYs(), num_combn, family, user_loss,
-        test_idx, x, fixedmap, y
+        x_test, fixed_test, y_test
     );
 
     // compute penalty path for 1st level variables
@@ -117,23 +158,57 @@ Eigen::VectorXd fitModelCV(const TX & x,
     double b0_outer = solver->getBeta0();
     Eigen::VectorXd betas_outer = solver->getBetas();
 
-    int idx_pen = 0;
-    for (int m = 0; m < num_penalty[0]; ++m) {
-        solver->setPenalty(path[m], 0);
-        for (int m2 = 0; m2 < num_penalty[1]; ++m2, ++idx_pen) {
-            solver->setPenalty(path_ext[m2], 1);
-            if (m2 == 0 && num_penalty[1] > 1) {
-                solver->warm_start(b0_outer, betas_outer);
-                solver->update_strong(path, path_ext, m, m2);
+    // variables with nonzero full-data estimates at each penalty (if given)
+    // are added to the strong set of the fold
+    const bool seed = seed_ptr.size() > 1;
+
+    if (serpentine) {
+        // rows of the grid alternate direction, each penalty starts from
+        // the solution at the previous one (its neighbour in the grid)
+        int m_prev = -1;
+        int m2_prev = -1;
+        for (int m = 0; m < num_penalty[0]; ++m) {
+            solver->setPenalty(path[m], 0);
+            for (int k = 0; k < num_penalty[1]; ++k) {
+                const int m2 = m % 2 == 0 ? k : num_penalty[1] - 1 - k;
+                const int idx_pen = m * num_penalty[1] + m2;
+                solver->setPenalty(path_ext[m2], 1);
+                solver->update_strong(path, path_ext, m, m2, m_prev, m2_prev);
+                if (seed) {
+                    solver->seed_strong(seed_idx.segment(seed_ptr[idx_pen], seed_ptr[idx_pen + 1] - seed_ptr[idx_pen]));
+                }
                 solver->solve();
-                b0_outer = solver->getBeta0();
-                betas_outer = solver->getBetas();
+                results.add_results(solver->getBeta0(), solver->getBetas(), idx_pen);
+                m_prev = m;
+                m2_prev = m2;
             }
-            else {
-                solver->update_strong(path, path_ext, m, m2);
-                solver->solve();
+        }
+    }
+    else {
+        int idx_pen = 0;
+        for (int m = 0; m < num_penalty[0]; ++m) {
+            solver->setPenalty(path[m], 0);
+            for (int m2 = 0; m2 < num_penalty[1]; ++m2, ++idx_pen) {
+                solver->setPenalty(path_ext[m2], 1);
+                if (m2 == 0 && num_penalty[1] > 1) {
+                    solver->warm_start(b0_outer, betas_outer);
+                    solver->update_strong(path, path_ext, m, m2);
+                    if (seed) {
+                        solver->seed_strong(seed_idx.segment(seed_ptr[idx_pen], seed_ptr[idx_pen + 1] - seed_ptr[idx_pen]));
+                    }
+                    solver->solve();
+                    b0_outer = solver->getBeta0();
+                    betas_outer = solver->getBetas();
+                }
+                else {
+                    solver->update_strong(path, path_ext, m, m2);
+                    if (seed) {
+                        solver->seed_strong(seed_idx.segment(seed_ptr[idx_pen], seed_ptr[idx_pen + 1] - seed_ptr[idx_pen]));
+                    }
+                    solver->solve();
+                }
+                results.add_results(solver->getBeta0(), solver->getBetas(), idx_pen);
             }
-            results.add_results(solver->getBeta0(), solver->getBetas(), idx_pen);
         }
     }
 
@@ -141,15 +216,114 @@ Eigen::VectorXd fitModelCV(const TX & x,
     return results.get_error_mat();
 }
 
+template <typename TX, typename TZ>
+Eigen::MatrixXd fitModelCVFolds(const TX & x,
+                                const bool & is_sparse_x,
+                                const Eigen::Ref<const Eigen::MatrixXd> & y,
+                                const TZ & ext,
+                                const Eigen::Ref<const Eigen::MatrixXd> & fixed,
+                                const Eigen::Ref<const Eigen::VectorXd> & weights_user,
+                                const std::vector<bool> & intr,
+                                const std::vector<bool> & stnd,
+                                const Eigen::Ref<const Eigen::VectorXd> & penalty_type,
+                                const Eigen::Ref<const Eigen::VectorXd> & cmult,
+                                const Eigen::Ref<const Eigen::VectorXd> & quantiles,
+                                const Eigen::Ref<const Eigen::VectorXi> & num_penalty,
+                                const Eigen::Ref<const Eigen::VectorXd> & penalty_ratio,
+                                const Eigen::Ref<const Eigen::VectorXd> & penalty_user,
+                                const Eigen::Ref<const Eigen::VectorXd> & penalty_user_ext,
+                                const Eigen::Ref<const Eigen::VectorXd> & lower_cl,
+                                const Eigen::Ref<const Eigen::VectorXd> & upper_cl,
+                                const std::string & family,
+                                const std::string & user_loss,
+                                const Eigen::Ref<const Eigen::VectorXi> & foldid,
+                                const Eigen::Ref<const Eigen::VectorXi> & folds,
+                                const double & thresh,
+                                const int & maxit,
+                                const int & ne,
+                                const int & nx,
+                                const bool & implicit_xz,
+                                const double & cache_size,
+                                const bool & bounded_hessian,
+                                const bool & dual_gap,
+                                const bool & working_set,
+                                const bool & anderson,
+                                const bool & serpentine,
+                                const Eigen::Ref<const Eigen::VectorXi> & seed_ptr,
+                                const Eigen::Ref<const Eigen::VectorXi> & seed_idx,
+                                const bool & compact_folds,
+                                const int & ncores) {
+
+    // errors for all penalty combinations (rows) in each fold (cols)
+    const int num_combn = num_penalty[0] * num_penalty[1];
+    Eigen::MatrixXd error_mat(num_combn, folds.size());
+
+    // folds share read-only x / ext / fixed, each thread owns its solver
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(ncores)
+#endif
+    for (int k = 0; k < folds.size(); ++k) {
+
+        // split into train and test rows for k-th fold
+        std::vector<int> train_obs;
+        std::vector<int> test_obs;
+        for (int i = 0; i < foldid.size(); ++i) {
+            if (foldid[i] == folds[k]) {
+                test_obs.push_back(i);
+            } else {
+                train_obs.push_back(i);
+            }
+        }
+
+        // copy of test rows used to score each fit
+        typename RowSubset<TX>::type x_test_storage;
+        const TX x_test = subset_rows(x, test_obs, x_test_storage);
+        const Eigen::MatrixXd y_test = subset_rows(y, test_obs);
+        const Eigen::MatrixXd fixed_test = subset_rows(fixed, test_obs);
+
+        if (compact_folds) {
+            // fit on a compacted copy of the training rows
+            typename RowSubset<TX>::type x_train_storage;
+            const TX x_train = subset_rows(x, train_obs, x_train_storage);
+            const Eigen::MatrixXd y_train = subset_rows(y, train_obs);
+            const Eigen::MatrixXd fixed_train = subset_rows(fixed, train_obs);
+            const Eigen::VectorXd weights_train = subset_rows(weights_user, train_obs);
+            error_mat.col(k) = fitModelCV<TX, TZ>(
+                x_train, is_sparse_x, y_train, ext, fixed_train, weights_train,
+                intr, stnd, penalty_type, cmult, quantiles, num_penalty,
+                penalty_ratio, penalty_user, penalty_user_ext, lower_cl,
+                upper_cl, family, user_loss, x_test, y_test, fixed_test,
+                thresh, maxit, ne, nx, implicit_xz, cache_size,
+                bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx
+            );
+        } else {
+            // fit on all rows with zero weight for held-out obs.
+            Eigen::VectorXd weights_train = weights_user;
+            for (std::size_t i = 0; i < test_obs.size(); ++i) {
+                weights_train[test_obs[i]] = 0.0;
+            }
+            error_mat.col(k) = fitModelCV<TX, TZ>(
+                x, is_sparse_x, y, ext, fixed, weights_train, intr, stnd,
+                penalty_type, cmult, quantiles, num_penalty, penalty_ratio,
+                penalty_user, penalty_user_ext, lower_cl, upper_cl, family,
+                user_loss, x_test, y_test, fixed_test, thresh, maxit, ne, nx,
+                implicit_xz, cache_size, bounded_hessian, dual_gap,
+                working_set, anderson, serpentine, seed_ptr, seed_idx
+            );
+        }
+    }
+    return error_mat;
+}
+
 
 // [[Rcpp::export]]
-Eigen::VectorXd fitModelCVRcpp(SEXP x,
+Eigen::MatrixXd fitModelCVRcpp(SEXP x,
                                const int mattype_x,
                                const Eigen::Map<Eigen::MatrixXd> y,
                                SEXP ext,
                                const bool & is_sparse_ext,
                                const Eigen::Map<Eigen::MatrixXd> fixed,
-                               Eigen::VectorXd weights_user,
+                               const Eigen::Map<Eigen::VectorXd> weights_user,
                                const Rcpp::LogicalVector & intr,
                                const Rcpp::LogicalVector & stnd,
                                const Eigen::Map<Eigen::VectorXd> penalty_type,
@@ -159,39 +333,65 @@ Eigen::VectorXd fitModelCVRcpp(SEXP x,
                                const Rcpp::NumericVector & penalty_ratio,
                                const Eigen::Map<Eigen::VectorXd> penalty_user,
                                const Eigen::Map<Eigen::VectorXd> penalty_user_ext,
-                               Eigen::VectorXd lower_cl,
-                               Eigen::VectorXd upper_cl,
+                               const Eigen::Map<Eigen::VectorXd> lower_cl,
+                               const Eigen::Map<Eigen::VectorXd> upper_cl,
                                const std::string & family,
                                const std::string & user_loss,
-                               const Eigen::Map<Eigen::VectorXi> test_idx,
+                               const Eigen::Map<Eigen::VectorXi> foldid,
+                               const Eigen::Map<Eigen::VectorXi> folds,
                                const double & thresh,
                                const int & maxit,
                                const int & ne,
-                               const int & nx) {
+                               const int & nx,
+                               const bool & implicit_xz,
+                               const double & cache_size,
+                               const bool & bounded_hessian,
+                               const bool & dual_gap,
+                               const bool & working_set,
+                               const bool & anderson,
+                               const bool & serpentine,
+                               const Rcpp::List & active_path,
+                               const bool & compact_folds,
+                               const int & ncores) {
+
+    // copy R vectors to plain C++ before handing off to worker threads
+    const std::vector<bool> intr_(intr.begin(), intr.end());
+    const std::vector<bool> stnd_(stnd.begin(), stnd.end());
+    const Eigen::VectorXi num_penalty_ = Eigen::Map<const Eigen::VectorXi>(&num_penalty[0], num_penalty.size());
+    const Eigen::VectorXd penalty_ratio_ = Eigen::Map<const Eigen::VectorXd>(&penalty_ratio[0], penalty_ratio.size());
+
+    // nonzero pattern of the full-data estimates (compressed sparse columns,
+    // one per penalty) used to seed the strong sets of the folds, if given
+    Eigen::VectorXi seed_ptr = Eigen::VectorXi::Zero(1);
+    Eigen::VectorXi seed_idx;
+    if (active_path.size() > 0) {
+        seed_ptr = Rcpp::as<Eigen::VectorXi>(active_path["p"]);
+        seed_idx = Rcpp::as<Eigen::VectorXi>(active_path["i"]);
+    }
 
     if (mattype_x == 1) {
         const bool is_sparse_x = false;
         Rcpp::NumericMatrix x_mat(x);
         MapMat xmap((const double *) &x_mat[0], x_mat.rows(), x_mat.cols());
         if (is_sparse_ext)
-            return fitModelCV<MapMat, MapSpMat>(
+            return fitModelCVFolds<MapMat, MapSpMat>(
                     xmap, is_sparse_x, y, Rcpp::as<MapSpMat>(ext),
-                    fixed, weights_user, intr, stnd, penalty_type,
-                    cmult, quantiles, num_penalty, penalty_ratio,
+                    fixed, weights_user, intr_, stnd_, penalty_type,
+                    cmult, quantiles, num_penalty_, penalty_ratio_,
                     penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, user_loss, test_idx, thresh,
-                    maxit, ne, nx
+                    upper_cl, family, user_loss, foldid, folds, thresh,
+                    maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx, compact_folds, ncores
                 );
         else {
             Rcpp::NumericMatrix ext_mat(ext);
             MapMat extmap((const double *) &ext_mat[0], ext_mat.rows(), ext_mat.cols());
-            return fitModelCV<MapMat, MapMat>(
+            return fitModelCVFolds<MapMat, MapMat>(
                     xmap, is_sparse_x, y, extmap, fixed,
-                    weights_user, intr, stnd, penalty_type,
-                    cmult, quantiles, num_penalty, penalty_ratio,
+                    weights_user, intr_, stnd_, penalty_type,
+                    cmult, quantiles, num_penalty_, penalty_ratio_,
                     penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, user_loss, test_idx,
-                    thresh, maxit, ne, nx
+                    upper_cl, family, user_loss, foldid, folds,
+                    thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx, compact_folds, ncores
                 );
         }
     } else if (mattype_x == 2) {
@@ -200,49 +400,75 @@ Eigen::VectorXd fitModelCVRcpp(SEXP x,
         Rcpp::XPtr<BigMatrix> xptr((SEXP) x_info.slot("address"));
         MapMat xmap((const double *)xptr->matrix(), xptr->nrow(), xptr->ncol());
         if (is_sparse_ext) {
-            return fitModelCV<MapMat, MapSpMat>(
+            return fitModelCVFolds<MapMat, MapSpMat>(
+                    xmap, is_sparse_x, y, Rcpp::as<MapSpMat>(ext), fixed,
+                    weights_user, intr_, stnd_, penalty_type,
+                    cmult, quantiles, num_penalty_, penalty_ratio_,
+                    penalty_user, penalty_user_ext, lower_cl,
+                    upper_cl, family, user_loss, foldid, folds,
+                    thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx, compact_folds, ncores
+                );
+        }
+        else {
+            Rcpp::NumericMatrix ext_mat(ext);
+            MapMat extmap((const double *) &ext_mat[0], ext_mat.rows(), ext_mat.cols());
+            return fitModelCVFolds<MapMat, MapMat>(
+                    xmap, is_sparse_x, y, extmap, fixed, weights_user,
+                    intr_, stnd_, penalty_type, cmult,
+                    quantiles, num_penalty_, penalty_ratio_,
+                    penalty_user, penalty_user_ext, lower_cl,
+                    upper_cl, family, user_loss, foldid, folds,
+                    thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx, compact_folds, ncores
+                );
+        }
+    } else if (mattype_x == 4) {
+        const bool is_sparse_x = false;
+        Eigen::MatrixXf x_storage;
+        MapMatF xmap = map_single_precision(x, x_storage);
+        if (is_sparse_ext) {
+            return fitModelCVFolds<MapMatF, MapSpMat>(
                     xmap, is_sparse_x, y, Rcpp::as<MapSpMat>(ext), fixed,
-                    weights_user, intr, stnd, penalty_type,
-                    cmult, quantiles, num_penalty, penalty_ratio,
+                    weights_user, intr_, stnd_, penalty_type,
+                    cmult, quantiles, num_penalty_, penalty_ratio_,
                     penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, user_loss, test_idx,
-                    thresh, maxit, ne, nx
+                    upper_cl, family, user_loss, foldid, folds,
+                    thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx, compact_folds, ncores
                 );
         }
         else {
             Rcpp::NumericMatrix ext_mat(ext);
             MapMat extmap((const double *) &ext_mat[0], ext_mat.rows(), ext_mat.cols());
-            return fitModelCV<MapMat, MapMat>(
+            return fitModelCVFolds<MapMatF, MapMat>(
                     xmap, is_sparse_x, y, extmap, fixed, weights_user,
-                    intr, stnd, penalty_type, cmult,
-                    quantiles, num_penalty, penalty_ratio,
+                    intr_, stnd_, penalty_type, cmult,
+                    quantiles, num_penalty_, penalty_ratio_,
                     penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, user_loss, test_idx,
-                    thresh, maxit, ne, nx
+                    upper_cl, family, user_loss, foldid, folds,
+                    thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx, compact_folds, ncores
                 );
         }
     } else {
         const bool is_sparse_x = true;
         if (is_sparse_ext) {
-            return fitModelCV<MapSpMat, MapSpMat>(
+            return fitModelCVFolds<MapSpMat, MapSpMat>(
                     Rcpp::as<MapSpMat>(x), is_sparse_x, y, Rcpp::as<MapSpMat>(ext), fixed,
-                    weights_user, intr, stnd, penalty_type,
-                    cmult, quantiles, num_penalty, penalty_ratio,
+                    weights_user, intr_, stnd_, penalty_type,
+                    cmult, quantiles, num_penalty_, penalty_ratio_,
                     penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, user_loss, test_idx,
-                    thresh, maxit, ne, nx
+                    upper_cl, family, user_loss, foldid, folds,
+                    thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx, compact_folds, ncores
             );
         }
         else {
             Rcpp::NumericMatrix ext_mat(ext);
             MapMat extmap((const double *) &ext_mat[0], ext_mat.rows(), ext_mat.cols());
-            return fitModelCV<MapSpMat, MapMat>(
+            return fitModelCVFolds<MapSpMat, MapMat>(
                     Rcpp::as<MapSpMat>(x), is_sparse_x, y, extmap,
-                    fixed, weights_user, intr, stnd, penalty_type, cmult,
-                    quantiles, num_penalty, penalty_ratio,
+                    fixed, weights_user, intr_, stnd_, penalty_type, cmult,
+                    quantiles, num_penalty_, penalty_ratio_,
                     penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, user_loss, test_idx,
-                    thresh, maxit, ne, nx
+                    upper_cl, family, user_loss, foldid, folds,
+                    thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, seed_ptr, seed_idx, compact_folds, ncores
             );
         }
     }
@@ -1,10 +1,20 @@
-#include <string.h>
+#include <RcppEigen.h>
+#include <bigmemory/MatrixAccessor.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "CoordDescTypes.h"
+#include "SinglePrecision.h"
 #include "DataFunctions.h"
 #include "Xrnet.h"
 #include "XrnetUtils.h"
 #include "GaussianSolver.h"
 #include "BinomialSolver.h"
+// [[Rcpp::depends(RcppEigen, BH, bigmemory)]]
 
 template <typename TX, typename TZ>
 Rcpp::List fitModel(const TX & x,
@@ -13,13 +23,13 @@ Rcpp::List fitModel(const TX & x,
                     const TZ & ext,
                     const Eigen::Ref<const Eigen::MatrixXd> & fixed,
                     Eigen::VectorXd weights_user,
-                    const Rcpp::LogicalVector & intr,
-                    const Rcpp::LogicalVector & stnd,
+                    const std::vector<bool> & intr,
+                    const std::vector<bool> & stnd,
                     const Eigen::Ref<const Eigen::VectorXd> & penalty_type,
                     const Eigen::Ref<const Eigen::VectorXd> & cmult,
                     const Eigen::Ref<const Eigen::VectorXd> & quantiles,
-                    const Rcpp::IntegerVector & num_penalty,
-                    const Rcpp::NumericVector & penalty_ratio,
+                    const Eigen::Ref<const Eigen::VectorXi> & num_penalty,
+                    const Eigen::Ref<const Eigen::VectorXd> & penalty_ratio,
                     const Eigen::Ref<const Eigen::VectorXd> & penalty_user,
                     const Eigen::Ref<const Eigen::VectorXd> & penalty_user_ext,
                     Eigen::VectorXd lower_cl,
@@ -28,7 +38,17 @@ Rcpp::List fitModel(const TX & x,
                     const double & thresh,
                     const int & maxit,
                     const int & ne,
-                    const int & nx) {
+                    const int & nx,
+                    const bool & implicit_xz,
+                    const double & cache_size,
+                    const bool & bounded_hessian,
+                    const bool & dual_gap,
+                    const bool & working_set,
+                    const bool & anderson,
+                    const bool & serpentine,
+                    const bool & sparse_path,
+                    const bool & seed_folds,
+                    const int & ncores) {
 
     // initialize objects to hold means, variances, sds of all variables
     const int n = x.rows();
@@ -47,14 +67,27 @@ Rcpp::List fitModel(const TX & x,
     // scale user weights
     weights_user.array() = weights_user.array() / weights_user.sum();
 
-    // compute moments of matrices and create XZ (if external data present)
+    // compute moments of matrices and create XZ (if external data present),
+    // XZ is applied from x / ext on the fly instead of stored if implicit_xz
     const bool center_x = intr[0] && !is_sparse_x;
     compute_moments(x, weights_user, xm, cent, xv, xs, center_x, stnd[0], 0);
     compute_moments(fixedmap, weights_user, xm, cent, xv, xs, center_x, stnd[0], nv_x);
-    const Eigen::MatrixXd xz = create_XZ(
-        x, ext, xm, cent, weights_user, xv,
-        xs, intr[1], stnd[1], nv_x + nv_fixed
-    );
+    Eigen::MatrixXd xz_dense;
+    Eigen::SparseMatrix<double> xz_weights;
+    Eigen::VectorXd xz_offset;
+    if (implicit_xz) {
+        xz_weights = create_XZ_implicit(
+            x, ext, xm, cent, weights_user, xv, xs,
+            xz_offset, intr[1], stnd[1], nv_x + nv_fixed
+        );
+    } else {
+        xz_dense = create_XZ(
+            x, ext, xm, cent, weights_user, xv,
+            xs, intr[1], stnd[1], nv_x + nv_fixed
+        );
+    }
+    const XZMatrix<TX> xz = implicit_xz ?
+        XZMatrix<TX>(x, xz_weights, xz_offset) : XZMatrix<TX>(xz_dense);
 
     // choose solver based on outcome
     std::unique_ptr<CoordSolver<TX> > solver;
@@ -64,7 +97,8 @@ Rcpp::List fitModel(const TX & x,
                 y, x, fixedmap, xz, cent.data(), xv.data(), xs.data(),
                 weights_user, intr[0], penalty_type.data(),
                 cmult.data(), quantiles, upper_cl.data(),
-                lower_cl.data(), ne, nx, thresh, maxit
+                lower_cl.data(), ne, nx, thresh, maxit,
+                dual_gap
             )
         );
 
@@ -75,19 +109,52 @@ Rcpp::List fitModel(const TX & x,
                 y, x, fixedmap, xz, cent.data(), xv.data(),
                 xs.data(), weights_user, intr[0], penalty_type.data(),
                 cmult.data(), quantiles, upper_cl.data(),
-                lower_cl.data(), ne, nx, thresh, maxit
+                lower_cl.data(), ne, nx, thresh, maxit,
+                bounded_hessian
             )
         );
     }
 
-    // Object to hold results for all penalty combinations
+    // memory for packed copies of active columns
+    solver->setCacheSize(cache_size);
+
+    // coordinate descent over a growing working set of strong features
+    solver->setWorkingSet(working_set);
+
+    // anderson extrapolation of passes over the active set
+    solver->setAnderson(anderson);
+
+    // rows of the penalty grid are solved in parallel by copies of the
+    // solver taken before any fitting (the setup is not repeated), each
+    // with its own weighted sum squares (updated by binomial solvers),
+    // single threaded sweeps and a share of the cache
+    const bool parallel_rows = ncores > 1 && num_penalty[0] > 1 && num_penalty[1] > 1;
+    Eigen::MatrixXd xv_rows;
+    std::vector<std::unique_ptr<CoordSolver<TX> > > solver_rows;
+    if (parallel_rows) {
+        xv_rows.resize(nv_total, ncores);
+        for (int t = 0; t < ncores; ++t) {
+            solver_rows.emplace_back(solver->clone(xv_rows.col(t).data()));
+            solver_rows.back()->setCacheSize(cache_size / ncores);
+        }
+    }
+
+    // threads used for full gradient sweeps (KKT checks, warm starts)
+    solver->setNumThreads(ncores);
+
+    // Object to hold results for all penalty combinations, estimates of x
+    // and external variables are kept as sparse columns if sparse_path
     const int num_combn = num_penalty[0] * num_penalty[1];
     Xrnet<TX, TZ> estimates = Xrnet<TX, TZ>(
         n, nv_x, nv_fixed, nv_ext, nv_total,
         intr[0], intr[1], ext, xm.data(), cent.data(),
-        xs.data(), solver->getYm(), solver->getYs(), num_combn
+        xs.data(), solver->getYm(), solver->getYs(), num_combn,
+        sparse_path
     );
 
+    // keep nonzero pattern of all estimates to seed strong sets of folds
+    estimates.setSaveActive(seed_folds);
+
     // compute penalty path for 1st level variables
     Eigen::VectorXd path(num_penalty[0]);
 
@@ -114,25 +181,118 @@ Rcpp::List fitModel(const TX & x,
     // solve grid of penalties in decreasing order
     double b0_outer = solver->getBeta0();
     Eigen::VectorXd betas_outer = solver->getBetas();
+    int num_passes = 0;
+    int status = 0;
 
-    int idx_pen = 0;
-    for (int m = 0; m < num_penalty[0]; ++m) {
-        solver->setPenalty(path[m], 0);
-        for (int m2 = 0; m2 < num_penalty[1]; ++m2, ++idx_pen) {
-            solver->setPenalty(path_ext[m2], 1);
-            if (m2 == 0 && num_penalty[1] > 1) {
-                solver->warm_start(b0_outer, betas_outer);
-                solver->update_strong(path, path_ext, m, m2);
-                solver->solve();
-                b0_outer = solver->getBeta0();
-                betas_outer = solver->getBetas();
+    if (parallel_rows) {
+        // sequential pass down the first column of the grid (m2 == 0), the
+        // rows are then solved in parallel, each from its first column
+        std::vector<double> b0_col(num_penalty[0]);
+        Eigen::MatrixXd betas_col(nv_total, num_penalty[0]);
+        for (int m = 0; m < num_penalty[0]; ++m) {
+            solver->setPenalty(path[m], 0);
+            solver->setPenalty(path_ext[0], 1);
+            solver->warm_start(b0_outer, betas_outer);
+            solver->update_strong(path, path_ext, m, 0);
+            solver->solve();
+            b0_outer = solver->getBeta0();
+            betas_outer = solver->getBetas();
+            b0_col[m] = b0_outer;
+            betas_col.col(m) = betas_outer;
+            estimates.add_results(b0_outer, betas_outer, m * num_penalty[1]);
+        }
+        num_passes += solver->getNumPasses();
+        status = solver->getStatus();
+
+        // each thread owns one of the solver copies, rows are handed out in
+        // order of decreasing penalty
+#ifdef _OPENMP
+        #pragma omp parallel num_threads(ncores)
+#endif
+        {
+#ifdef _OPENMP
+            CoordSolver<TX> * solver_row = solver_rows[omp_get_thread_num()].get();
+#else
+            CoordSolver<TX> * solver_row = solver_rows[0].get();
+#endif
+            Eigen::VectorXi nz_idx(nv_total);
+
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
+#endif
+            for (int m = 0; m < num_penalty[0]; ++m) {
+
+                // restart from the solution in the first column (already
+                // solved), features with nonzero estimates must be in the
+                // strong set of this solver
+                int num_nz = 0;
+                for (int k = 0; k < nv_total; ++k) {
+                    if (betas_col(k, m) != 0.0) nz_idx[num_nz++] = k;
+                }
+                solver_row->setPenalty(path[m], 0);
+                solver_row->warm_start(b0_col[m], betas_col.col(m));
+                solver_row->seed_strong(nz_idx.head(num_nz));
+
+                int idx_pen = m * num_penalty[1] + 1;
+                for (int m2 = 1; m2 < num_penalty[1]; ++m2, ++idx_pen) {
+                    solver_row->setPenalty(path_ext[m2], 1);
+                    solver_row->update_strong(path, path_ext, m, m2);
+                    solver_row->solve();
+                    estimates.add_results(solver_row->getBeta0(), solver_row->getBetas(), idx_pen);
+                }
+            }
+
+#ifdef _OPENMP
+            #pragma omp critical
+#endif
+            {
+                num_passes += solver_row->getNumPasses();
+                status = std::max(status, solver_row->getStatus());
             }
-            else {
-                solver->update_strong(path, path_ext, m, m2);
+        }
+    }
+    else if (serpentine) {
+        // rows of the grid alternate direction, each penalty starts from
+        // the solution at the previous one (its neighbour in the grid)
+        int m_prev = -1;
+        int m2_prev = -1;
+        for (int m = 0; m < num_penalty[0]; ++m) {
+            solver->setPenalty(path[m], 0);
+            for (int k = 0; k < num_penalty[1]; ++k) {
+                const int m2 = m % 2 == 0 ? k : num_penalty[1] - 1 - k;
+                solver->setPenalty(path_ext[m2], 1);
+                solver->update_strong(path, path_ext, m, m2, m_prev, m2_prev);
                 solver->solve();
+                estimates.add_results(solver->getBeta0(), solver->getBetas(), m * num_penalty[1] + m2);
+                m_prev = m;
+                m2_prev = m2;
+            }
+        }
+        num_passes = solver->getNumPasses();
+        status = solver->getStatus();
+    }
+    else {
+        int idx_pen = 0;
+        for (int m = 0; m < num_penalty[0]; ++m) {
+            solver->setPenalty(path[m], 0);
+            for (int m2 = 0; m2 < num_penalty[1]; ++m2, ++idx_pen) {
+                solver->setPenalty(path_ext[m2], 1);
+                if (m2 == 0 && num_penalty[1] > 1) {
+                    solver->warm_start(b0_outer, betas_outer);
+                    solver->update_strong(path, path_ext, m, m2);
+                    solver->solve();
+                    b0_outer = solver->getBeta0();
+                    betas_outer = solver->getBetas();
+                }
+                else {
+                    solver->update_strong(path, path_ext, m, m2);
+                    solver->solve();
+                }
+                estimates.add_results(solver->getBeta0(), solver->getBetas(), idx_pen);
             }
-            estimates.add_results(solver->getBeta0(), solver->getBetas(), idx_pen);
         }
+        num_passes = solver->getNumPasses();
+        status = solver->getStatus();
     }
 
     // fix first penalties (when path automatically computed)
@@ -144,7 +304,7 @@ Rcpp::List fitModel(const TX & x,
     }
 
     // collect results in list and return to R
-    return Rcpp::List::create(
+    Rcpp::List fit = Rcpp::List::create(
             Rcpp::Named("beta0") = estimates.getBeta0(),
             Rcpp::Named("betas") = estimates.getBetas(),
             Rcpp::Named("gammas") = estimates.getGammas(),
@@ -152,10 +312,27 @@ Rcpp::List fitModel(const TX & x,
             Rcpp::Named("alphas") = estimates.getAlphas(),
             Rcpp::Named("penalty") = solver->getYs() * path,
             Rcpp::Named("penalty_ext") = solver->getYs() * path_ext,
-            Rcpp::Named("num_passes") = solver->getNumPasses(),
+            Rcpp::Named("num_passes") = num_passes,
             Rcpp::Named("family") = family,
-            Rcpp::Named("status") = solver->getStatus()
+            Rcpp::Named("status") = status
+        );
+    if (sparse_path) {
+        // returned as dgCMatrix, one column per penalty
+        fit["betas"] = estimates.getBetasSparse(num_penalty[1]);
+        fit["alphas"] = estimates.getAlphasSparse(num_penalty[1]);
+    }
+    if (seed_folds) {
+        // compressed sparse column pattern (one column per penalty)
+        const Eigen::SparseMatrix<double> active_path = estimates.getActivePath();
+        fit.push_back(
+            Rcpp::List::create(
+                Rcpp::Named("p") = Eigen::VectorXi(Eigen::Map<const Eigen::VectorXi>(active_path.outerIndexPtr(), active_path.cols() + 1)),
+                Rcpp::Named("i") = Eigen::VectorXi(Eigen::Map<const Eigen::VectorXi>(active_path.innerIndexPtr(), active_path.nonZeros()))
+            ),
+            "active_path"
         );
+    }
+    return fit;
 }
 
 
@@ -182,7 +359,23 @@ Rcpp::List fitModelRcpp(SEXP x,
                         const double & thresh,
                         const int & maxit,
                         const int & ne,
-                        const int & nx) {
+                        const int & nx,
+                        const bool & implicit_xz,
+                        const double & cache_size,
+                        const bool & bounded_hessian,
+                        const bool & dual_gap,
+                        const bool & working_set,
+                        const bool & anderson,
+                        const bool & serpentine,
+                        const bool & sparse_path,
+                        const bool & seed_folds,
+                        const int & ncores) {
+
+    // copy R vectors to plain C++ before entering solver code
+    const std::vector<bool> intr_(intr.begin(), intr.end());
+    const std::vector<bool> stnd_(stnd.begin(), stnd.end());
+    const Eigen::VectorXi num_penalty_ = Eigen::Map<const Eigen::VectorXi>(&num_penalty[0], num_penalty.size());
+    const Eigen::VectorXd penalty_ratio_ = Eigen::Map<const Eigen::VectorXd>(&penalty_ratio[0], penalty_ratio.size());
 
     if (mattype_x == 1) {
         const bool is_sparse_x = false;
@@ -191,19 +384,19 @@ Rcpp::List fitModelRcpp(SEXP x,
         if (is_sparse_ext)
             return fitModel<MapMat, MapSpMat>(
                     xmap, is_sparse_x, y, Rcpp::as<MapSpMat>(ext),
-                    fixed, weights_user, intr, stnd, penalty_type, cmult,
-                    quantiles, num_penalty, penalty_ratio, penalty_user,
+                    fixed, weights_user, intr_, stnd_, penalty_type, cmult,
+                    quantiles, num_penalty_, penalty_ratio_, penalty_user,
                     penalty_user_ext, lower_cl, upper_cl, family, thresh,
-                    maxit, ne, nx
+                    maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores
                 );
         else {
             Rcpp::NumericMatrix ext_mat(ext);
             MapMat extmap((const double *) &ext_mat[0], ext_mat.rows(), ext_mat.cols());
             return fitModel<MapMat, MapMat>(
                     xmap, is_sparse_x, y, extmap, fixed, weights_user,
-                    intr, stnd, penalty_type, cmult, quantiles, num_penalty,
-                    penalty_ratio, penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, thresh, maxit, ne, nx
+                    intr_, stnd_, penalty_type, cmult, quantiles, num_penalty_,
+                    penalty_ratio_, penalty_user, penalty_user_ext, lower_cl,
+                    upper_cl, family, thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores
                 );
         }
     } else if (mattype_x == 2) {
@@ -214,19 +407,41 @@ Rcpp::List fitModelRcpp(SEXP x,
         if (is_sparse_ext) {
             return fitModel<MapMat, MapSpMat>(
                     xmap, is_sparse_x, y, Rcpp::as<MapSpMat>(ext), fixed, weights_user,
-                    intr, stnd, penalty_type, cmult, quantiles, num_penalty,
-                    penalty_ratio, penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, thresh, maxit, ne, nx
+                    intr_, stnd_, penalty_type, cmult, quantiles, num_penalty_,
+                    penalty_ratio_, penalty_user, penalty_user_ext, lower_cl,
+                    upper_cl, family, thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores
             );
         }
         else {
             Rcpp::NumericMatrix ext_mat(ext);
             MapMat extmap((const double *) &ext_mat[0], ext_mat.rows(), ext_mat.cols());
             return fitModel<MapMat, MapMat>(
-                    xmap, is_sparse_x, y, extmap, fixed, weights_user, intr, stnd,
-                    penalty_type, cmult, quantiles, num_penalty,
-                    penalty_ratio, penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, thresh, maxit, ne, nx
+                    xmap, is_sparse_x, y, extmap, fixed, weights_user, intr_, stnd_,
+                    penalty_type, cmult, quantiles, num_penalty_,
+                    penalty_ratio_, penalty_user, penalty_user_ext, lower_cl,
+                    upper_cl, family, thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores
+            );
+        }
+    } else if (mattype_x == 4) {
+        const bool is_sparse_x = false;
+        Eigen::MatrixXf x_storage;
+        MapMatF xmap = map_single_precision(x, x_storage);
+        if (is_sparse_ext) {
+            return fitModel<MapMatF, MapSpMat>(
+                    xmap, is_sparse_x, y, Rcpp::as<MapSpMat>(ext), fixed, weights_user,
+                    intr_, stnd_, penalty_type, cmult, quantiles, num_penalty_,
+                    penalty_ratio_, penalty_user, penalty_user_ext, lower_cl,
+                    upper_cl, family, thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores
+            );
+        }
+        else {
+            Rcpp::NumericMatrix ext_mat(ext);
+            MapMat extmap((const double *) &ext_mat[0], ext_mat.rows(), ext_mat.cols());
+            return fitModel<MapMatF, MapMat>(
+                    xmap, is_sparse_x, y, extmap, fixed, weights_user, intr_, stnd_,
+                    penalty_type, cmult, quantiles, num_penalty_,
+                    penalty_ratio_, penalty_user, penalty_user_ext, lower_cl,
+                    upper_cl, family, thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores
             );
         }
     } else {
@@ -234,19 +449,19 @@ Rcpp::List fitModelRcpp(SEXP x,
         if (is_sparse_ext)
             return fitModel<MapSpMat, MapSpMat>(
                     Rcpp::as<MapSpMat>(x), is_sparse_x, y, Rcpp::as<MapSpMat>(ext),
-                    fixed, weights_user, intr, stnd, penalty_type, cmult,
-                    quantiles, num_penalty, penalty_ratio, penalty_user,
+                    fixed, weights_user, intr_, stnd_, penalty_type, cmult,
+                    quantiles, num_penalty_, penalty_ratio_, penalty_user,
                     penalty_user_ext, lower_cl, upper_cl, family, thresh,
-                    maxit, ne, nx
+                    maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores
             );
         else {
             Rcpp::NumericMatrix ext_mat(ext);
             MapMat extmap((const double *) &ext_mat[0], ext_mat.rows(), ext_mat.cols());
             return fitModel<MapSpMat, MapMat>(
                     Rcpp::as<MapSpMat>(x), is_sparse_x, y, extmap, fixed, weights_user,
-                    intr, stnd, penalty_type, cmult, quantiles, num_penalty,
-                    penalty_ratio, penalty_user, penalty_user_ext, lower_cl,
-                    upper_cl, family, thresh, maxit, ne, nx
+                    intr_, stnd_, penalty_type, cmult, quantiles, num_penalty_,
+                    penalty_ratio_, penalty_user, penalty_user_ext, lower_cl,
+                    upper_cl, family, thresh, maxit, ne, nx, implicit_xz, cache_size, bounded_hessian, dual_gap, working_set, anderson, serpentine, sparse_path, seed_folds, ncores
             );
         }
     }
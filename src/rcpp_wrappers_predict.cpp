@@ -0,0 +1,53 @@
+#include <RcppEigen.h>
+#include <bigmemory/MatrixAccessor.hpp>
+#include "CoordDescTypes.h"
+#include "SinglePrecision.h"
+#include "XrnetUtils.h"
+// [[Rcpp::depends(RcppEigen, BH, bigmemory)]]
+
+// betas are a matrix or, for paths stored sparse, a dgCMatrix
+template <typename TX>
+Eigen::MatrixXd computeResponseBetas(const TX & X,
+                                     const Eigen::Ref<const Eigen::MatrixXd> & Fixed,
+                                     const Eigen::Ref<const Eigen::VectorXd> & beta0,
+                                     SEXP betas,
+                                     const bool & is_sparse_betas,
+                                     const Eigen::Ref<const Eigen::MatrixXd> & gammas,
+                                     const std::string & response_type,
+                                     const std::string & family) {
+    if (is_sparse_betas) {
+        return computeResponse<TX, MapSpMat>(X, Fixed, beta0, Rcpp::as<MapSpMat>(betas), gammas, response_type, family);
+    }
+    Rcpp::NumericMatrix betas_mat(betas);
+    MapMat betas_map((const double *) &betas_mat[0], betas_mat.rows(), betas_mat.cols());
+    return computeResponse<TX, MapMat>(X, Fixed, beta0, betas_map, gammas, response_type, family);
+}
+
+// [[Rcpp::export]]
+Eigen::MatrixXd computeResponseRcpp(SEXP X,
+                                    const int & mattype_x,
+                                    const Eigen::Map<Eigen::MatrixXd> Fixed,
+                                    const Eigen::Map<Eigen::VectorXd> beta0,
+                                    SEXP betas,
+                                    const bool & is_sparse_betas,
+                                    const Eigen::Map<Eigen::MatrixXd> gammas,
+                                    const std::string & response_type,
+                                    const std::string & family) {
+
+    if (mattype_x == 1) {
+        Rcpp::NumericMatrix x_mat(X);
+        MapMat xmap((const double *) &x_mat[0], x_mat.rows(), x_mat.cols());
+        return computeResponseBetas<MapMat>(xmap, Fixed, beta0, betas, is_sparse_betas, gammas, response_type, family);
+    } else if (mattype_x == 2) {
+        Rcpp::S4 x_info(X);
+        Rcpp::XPtr<BigMatrix> xptr((SEXP) x_info.slot("address"));
+        MapMat xmap((const double *)xptr->matrix(), xptr->nrow(), xptr->ncol());
+        return computeResponseBetas<MapMat>(xmap, Fixed, beta0, betas, is_sparse_betas, gammas, response_type, family);
+    } else if (mattype_x == 4) {
+        Eigen::MatrixXf x_storage;
+        MapMatF xmap = map_single_precision(X, x_storage);
+        return computeResponseBetas<MapMatF>(xmap, Fixed, beta0, betas, is_sparse_betas, gammas, response_type, family);
+    } else {
+        return computeResponseBetas<MapSpMat>(Rcpp::as<MapSpMat>(X), Fixed, beta0, betas, is_sparse_betas, gammas, response_type, family);
+    }
+}